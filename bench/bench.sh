@@ -0,0 +1,85 @@
+#!/bin/sh
+# End-to-end throughput benchmark for sickle, run by `make bench`.
+#
+# Generates synthetic input with fqgen, runs sickle se and pe (separate
+# files, -m and -M, each with and without -g) and writes one line per run
+# to a tab-separated results file: reads/s, MB/s of uncompressed input and
+# peak RSS. The data and the outputs go to BENCH_DIR.
+#
+# Settings (environment):
+#   READS     reads (pairs for pe) to generate, default 1000000
+#   LENGTH    read length, default 150
+#   PROFILE   quality profile: good, typical or poor, default typical
+#   NRATE     fraction of N bases, default 0.001
+#   THREADS   sickle -T, default 1
+#   EXTRA     further options for every sickle run
+#   BENCH_DIR scratch directory, default bench/work
+#   RESULTS   results file, default bench/results.tsv
+
+set -e
+
+BENCH=$(dirname "$0")
+SICKLE=${SICKLE:-./sickle}
+READS=${READS:-1000000}
+LENGTH=${LENGTH:-150}
+PROFILE=${PROFILE:-typical}
+NRATE=${NRATE:-0.001}
+THREADS=${THREADS:-1}
+EXTRA=${EXTRA:-}
+BENCH_DIR=${BENCH_DIR:-$BENCH/work}
+RESULTS=${RESULTS:-$BENCH/results.tsv}
+
+mkdir -p "$BENCH_DIR"
+D=$BENCH_DIR
+GEN="$BENCH/fqgen -n $READS -l $LENGTH -p $PROFILE -N $NRATE"
+
+# input data, regenerated only when the settings change
+STAMP="$READS $LENGTH $PROFILE $NRATE"
+if [ ! -f "$D/stamp" ] || [ "$(cat "$D/stamp")" != "$STAMP" ]; then
+    echo "Generating $READS reads of $LENGTH bp ($PROFILE profile) in $D"
+    $GEN -L se -o "$D/se"
+    $GEN -L pe -o "$D/pe"
+    $GEN -L combo -o "$D/pe"
+    gzip -1 -c "$D/se.fq" > "$D/se.fq.gz"
+    gzip -1 -c "$D/pe_1.fq" > "$D/pe_1.fq.gz"
+    gzip -1 -c "$D/pe_2.fq" > "$D/pe_2.fq.gz"
+    echo "$STAMP" > "$D/stamp"
+fi
+
+SE_BYTES=$(wc -c < "$D/se.fq")
+PE_BYTES=$(($(wc -c < "$D/pe_1.fq") + $(wc -c < "$D/pe_2.fq")))
+
+printf '# sickle benchmark\tdate=%s\thost=%s\treads=%s\tlength=%s\tprofile=%s\tn_rate=%s\tthreads=%s\textra=%s\n' \
+    "$(date -u +%Y-%m-%dT%H:%M:%SZ)" "$(uname -n)" "$READS" "$LENGTH" "$PROFILE" "$NRATE" "$THREADS" "$EXTRA" > "$RESULTS"
+printf 'case\treads\tinput_bytes\twall_s\tuser_s\tsys_s\treads_per_s\tmb_per_s\tpeak_rss_kb\texit_status\n' >> "$RESULTS"
+
+# run <case> <reads> <input bytes> <sickle arguments...>
+run () {
+    name=$1 reads=$2 bytes=$3
+    shift 3
+    status=0
+    "$BENCH/timeit" "$D/time" $SICKLE "$@" -T "$THREADS" --quiet $EXTRA > /dev/null || status=$?
+    awk -v name="$name" -v reads="$reads" -v bytes="$bytes" 'BEGIN { FS = OFS = "\t" } {
+        wall = ($1 > 0) ? $1 : 0.001
+        printf "%s\t%d\t%d\t%.3f\t%.3f\t%.3f\t%.0f\t%.2f\t%d\t%d\n", name, reads, bytes, $1, $2, $3, reads / wall, bytes / 1e6 / wall, $4, $5
+    }' "$D/time" | tee -a "$RESULTS"
+    if [ $status -ne 0 ]; then
+        echo "$name: sickle exited with status $status" >&2
+    fi
+    rm -f "$D"/out*
+}
+
+PAIRS=$((READS * 2))
+
+run se "$READS" "$SE_BYTES" se -f "$D/se.fq" -t sanger -o "$D/out.fq"
+run se_g "$READS" "$SE_BYTES" se -f "$D/se.fq" -t sanger -o "$D/out.fq.gz" -g
+run se_gzin "$READS" "$SE_BYTES" se -f "$D/se.fq.gz" -t sanger -o "$D/out.fq"
+run pe "$PAIRS" "$PE_BYTES" pe -f "$D/pe_1.fq" -r "$D/pe_2.fq" -t sanger -o "$D/out1.fq" -p "$D/out2.fq" -s "$D/outs.fq"
+run pe_g "$PAIRS" "$PE_BYTES" pe -f "$D/pe_1.fq" -r "$D/pe_2.fq" -t sanger -o "$D/out1.fq.gz" -p "$D/out2.fq.gz" -s "$D/outs.fq.gz" -g
+run pe_gzin "$PAIRS" "$PE_BYTES" pe -f "$D/pe_1.fq.gz" -r "$D/pe_2.fq.gz" -t sanger -o "$D/out1.fq" -p "$D/out2.fq" -s "$D/outs.fq"
+run pe_m "$PAIRS" "$PE_BYTES" pe -c "$D/pe_c.fq" -t sanger -m "$D/outm.fq" -s "$D/outs.fq"
+run pe_m_g "$PAIRS" "$PE_BYTES" pe -c "$D/pe_c.fq" -t sanger -m "$D/outm.fq.gz" -s "$D/outs.fq.gz" -g
+run pe_M "$PAIRS" "$PE_BYTES" pe -c "$D/pe_c.fq" -t sanger -M "$D/outM.fq"
+run pe_M_g "$PAIRS" "$PE_BYTES" pe -c "$D/pe_c.fq" -t sanger -M "$D/outM.fq.gz" -g
+
+echo "Results written to $RESULTS"
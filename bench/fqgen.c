@@ -0,0 +1,237 @@
+/* fqgen: write synthetic Sanger-encoded FastQ data for benchmarking sickle.
+
+   The qualities follow one of three profiles, each a mean that falls
+   along the read plus random noise:
+
+     good      high quality throughout (few reads need trimming)
+     typical   slow decline towards the 3' end
+     poor      steep decline, low-quality runs at both ends
+
+   Bases are called N at a given rate, with quality 2. The layout is a
+   single file (se), two mate files (pe) or one interleaved file (combo). */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <zlib.h>
+
+typedef enum {
+    LAYOUT_SE,
+    LAYOUT_PE,
+    LAYOUT_COMBO
+} layout_type;
+
+typedef struct {
+    double start, end;  /* mean quality at the first and the last base */
+    double noise;       /* maximum deviation from the mean */
+    double dip;         /* chance of a read starting or ending in a low-quality run */
+} quality_profile;
+
+static const char *profile_names[] = {"good", "typical", "poor"};
+static const quality_profile profiles[] = {
+    {38, 34, 3, 0.02},  /* good */
+    {36, 24, 8, 0.10},  /* typical */
+    {32, 12, 10, 0.35}  /* poor */
+};
+
+/* xorshift64*, so that the data only depends on the seed */
+static unsigned long long rng_state = 88172645463325252ULL;
+
+static double rng (void) {
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return (double) ((rng_state * 2685821657736338717ULL) >> 11) / 9007199254740992.0;
+}
+
+/* output file, plain or gzip */
+typedef struct {
+    FILE *fp;
+    gzFile gz;
+} genfile;
+
+static void gen_open (genfile *f, const char *path, int gzip) {
+    f->fp = NULL;
+    f->gz = NULL;
+    if (gzip) f->gz = gzopen(path, "wb1");
+    else f->fp = fopen(path, "w");
+    if (!f->fp && !f->gz) {
+        fprintf(stderr, "****Error: Could not open output file '%s'.\n", path);
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void gen_write (genfile *f, const char *s, size_t len) {
+    if (f->gz) gzwrite(f->gz, s, (unsigned) len);
+    else fwrite(s, 1, len, f->fp);
+}
+
+static void gen_close (genfile *f) {
+    if (f->gz) gzclose(f->gz);
+    else fclose(f->fp);
+}
+
+static void make_read (char *rec, size_t *reclen, long id, int mate, int length, const quality_profile *p, double nrate) {
+    static const char bases[] = "ACGT";
+    char *s = rec;
+    int i, q, dip5 = 0, dip3 = 0;
+    double mean;
+
+    if (rng() < p->dip) dip5 = (int) (rng() * length * 0.1);
+    if (rng() < p->dip) dip3 = (int) (rng() * length * 0.3);
+
+    if (mate) s += sprintf(s, "@read%ld/%d len=%d\n", id, mate, length);
+    else s += sprintf(s, "@read%ld len=%d\n", id, length);
+
+    /* the sequence and quality lines are filled in together */
+    for (i = 0; i < length; i++) {
+        mean = p->start + (p->end - p->start) * i / (length > 1 ? length - 1 : 1);
+        q = (int) (mean + (rng() * 2 - 1) * p->noise);
+        if (i < dip5 || i >= length - dip3) q = (int) (rng() * 12);
+        if (q < 2) q = 2;
+        if (q > 41) q = 41;
+
+        if (rng() < nrate) {
+            s[i] = 'N';
+            q = 2;
+        } else {
+            s[i] = bases[(int) (rng() * 4)];
+        }
+        s[length + 3 + i] = (char) (q + 33);
+    }
+    memcpy(s + length, "\n+\n", 3);
+    s[2 * length + 3] = '\n';
+    *reclen = (s - rec) + 2 * length + 4;
+}
+
+static void usage (int status) {
+    fprintf(stderr, "\nUsage: fqgen [options] -o <output prefix>\n\
+\n\
+Options:\n\
+-o, --output-prefix, Prefix of the output files: <prefix>.fq for se, <prefix>_1.fq and <prefix>_2.fq for pe, <prefix>_c.fq for combo (required)\n\
+-n, --reads, Number of reads (pairs for pe and combo). Default 1000000.\n\
+-l, --length, Read length. Default 150.\n\
+-p, --profile, Quality profile: good, typical or poor. Default typical.\n\
+-N, --n-rate, Fraction of bases called N. Default 0.001.\n\
+-L, --layout, se, pe or combo. Default se.\n\
+-z, --gzip, Write gzip-compressed files (.fq.gz).\n\
+-s, --seed, Random seed. Default 1.\n\
+--help, display this help and exit\n\n");
+    exit(status);
+}
+
+static struct option fqgen_long_options[] = {
+    {"output-prefix", required_argument, 0, 'o'},
+    {"reads", required_argument, 0, 'n'},
+    {"length", required_argument, 0, 'l'},
+    {"profile", required_argument, 0, 'p'},
+    {"n-rate", required_argument, 0, 'N'},
+    {"layout", required_argument, 0, 'L'},
+    {"gzip", no_argument, 0, 'z'},
+    {"seed", required_argument, 0, 's'},
+    {"help", no_argument, 0, 'h'},
+    {NULL, 0, NULL, 0}
+};
+
+int main (int argc, char *argv[]) {
+    const char *prefix = NULL;
+    long reads = 1000000, i;
+    int length = 150;
+    int profile = 1;
+    double nrate = 0.001;
+    layout_type layout = LAYOUT_SE;
+    int gzip = 0;
+    int optc, k;
+    char path[4096];
+    char *rec;
+    size_t reclen;
+    genfile out[2];
+
+    while ((optc = getopt_long(argc, argv, "o:n:l:p:N:L:zs:", fqgen_long_options, NULL)) != -1) {
+        switch (optc) {
+        case 'o':
+            prefix = optarg;
+            break;
+
+        case 'n':
+            reads = atol(optarg);
+            break;
+
+        case 'l':
+            length = atoi(optarg);
+            if (length < 1) {
+                fprintf(stderr, "Read length must be >= 1\n");
+                return EXIT_FAILURE;
+            }
+            break;
+
+        case 'p':
+            for (profile = 0; profile < 3 && strcmp(optarg, profile_names[profile]); profile++);
+            if (profile == 3) {
+                fprintf(stderr, "Error: Quality profile '%s' is not a valid profile.\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+
+        case 'N':
+            nrate = atof(optarg);
+            break;
+
+        case 'L':
+            if (!strcmp(optarg, "se")) layout = LAYOUT_SE;
+            else if (!strcmp(optarg, "pe")) layout = LAYOUT_PE;
+            else if (!strcmp(optarg, "combo")) layout = LAYOUT_COMBO;
+            else {
+                fprintf(stderr, "Error: Layout '%s' is not a valid layout.\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+
+        case 'z':
+            gzip = 1;
+            break;
+
+        case 's':
+            rng_state ^= strtoull(optarg, NULL, 10) * 0x9E3779B97F4A7C15ULL;
+            break;
+
+        case 'h':
+            usage(EXIT_SUCCESS);
+            break;
+
+        default:
+            usage(EXIT_FAILURE);
+        }
+    }
+
+    if (!prefix) usage(EXIT_FAILURE);
+
+    if (layout == LAYOUT_PE) {
+        snprintf(path, sizeof path, "%s_1.fq%s", prefix, gzip ? ".gz" : "");
+        gen_open(&out[0], path, gzip);
+        snprintf(path, sizeof path, "%s_2.fq%s", prefix, gzip ? ".gz" : "");
+        gen_open(&out[1], path, gzip);
+    } else {
+        snprintf(path, sizeof path, "%s%s.fq%s", prefix, layout == LAYOUT_COMBO ? "_c" : "", gzip ? ".gz" : "");
+        gen_open(&out[0], path, gzip);
+    }
+
+    rec = (char *) malloc(2 * length + 128);
+    for (i = 0; i < reads; i++) {
+        if (layout == LAYOUT_SE) {
+            make_read(rec, &reclen, i, 0, length, &profiles[profile], nrate);
+            gen_write(&out[0], rec, reclen);
+            continue;
+        }
+        for (k = 0; k < 2; k++) {
+            make_read(rec, &reclen, i, k + 1, length, &profiles[profile], nrate);
+            gen_write(&out[layout == LAYOUT_PE ? k : 0], rec, reclen);
+        }
+    }
+    free(rec);
+
+    gen_close(&out[0]);
+    if (layout == LAYOUT_PE) gen_close(&out[1]);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,314 @@
+/* kernels: microbenchmark and equivalence fuzzer for the window search.
+
+   This includes sliding.c itself, so it reaches the scalar reference
+   (sliding_scalar), the vector kernels and the batch variants without
+   any file I/O:
+
+     kernels bench [-b bases] [-s seed]
+         times every implementation on in-memory reads, for read lengths
+         from 35 bp to 100 kb, several window sizes (as a fraction of the
+         read length) and quality distributions, and prints ns/base as
+         tab-separated lines
+
+     kernels fuzz [-i iterations] [-s seed]
+         compares every kernel, sliding_window() and the batch variants
+         with the scalar reference on random reads and settings; exits
+         with status 1 on the first differences in cutsites */
+
+#include "../src/sliding.c"
+#include <time.h>
+
+static const char *kernel_names[] = {"sse4.2", "avx2", "avx512"};
+#define NKERNELS 3
+
+static const int lengths[] = {35, 50, 75, 100, 150, 250, 500, 1000, 5000, 20000, 100000};
+#define NLENGTHS (sizeof lengths / sizeof lengths[0])
+static const double fractions[] = {0.05, 0.1, 0.2, 0.5};
+#define NFRACTIONS (sizeof fractions / sizeof fractions[0])
+
+/* quality distributions: mean at both ends, noise, and how often a read
+   has a low-quality run at either end */
+typedef struct {
+    const char *name;
+    double start, end, noise, dip;
+} quality_dist;
+
+static const quality_dist dists[] = {
+    {"good", 38, 34, 3, 0.02},
+    {"typical", 36, 24, 8, 0.10},
+    {"poor", 32, 12, 10, 0.35},
+    {"uniform", 20, 20, 21, 0}
+};
+#define NDISTS (sizeof dists / sizeof dists[0])
+
+static unsigned long long rng_state = 88172645463325252ULL;
+
+static unsigned int rng (void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return (unsigned int) (rng_state >> 11);
+}
+
+static double rngf (void) {
+    return (rng () & 0xffffff) / 16777216.0;
+}
+
+/* A set of n reads of one length, sharing one buffer. */
+typedef struct {
+    kseq_t *rec;
+    cutsites *cut;
+    char *seq, *qual;
+    int n, len;
+} read_set;
+
+static void make_reads (read_set *rs, int n, int len, const quality_dist *d, int qualtype, double nrate) {
+    int lo = quality_constants[qualtype][Q_MIN], hi = quality_constants[qualtype][Q_MAX];
+    int off = quality_constants[qualtype][Q_OFFSET];
+    int i, j, q, dip5, dip3;
+    char *s, *qs;
+
+    rs->n = n;
+    rs->len = len;
+    rs->rec = (kseq_t *) calloc (n, sizeof (kseq_t));
+    rs->cut = (cutsites *) calloc (n, sizeof (cutsites));
+    rs->seq = (char *) malloc ((size_t) n * (len + 1));
+    rs->qual = (char *) malloc ((size_t) n * (len + 1));
+
+    for (i = 0; i < n; i++) {
+        s = rs->seq + (size_t) i * (len + 1);
+        qs = rs->qual + (size_t) i * (len + 1);
+        dip5 = (rngf () < d->dip) ? (int) (rngf () * len * 0.1) : 0;
+        dip3 = (rngf () < d->dip) ? (int) (rngf () * len * 0.3) : 0;
+
+        for (j = 0; j < len; j++) {
+            q = (int) (d->start + (d->end - d->start) * j / (len > 1 ? len - 1 : 1) + (rngf () * 2 - 1) * d->noise);
+            if (j < dip5 || j >= len - dip3) q = rng () % 12;
+            q += off;
+            if (q < lo) q = lo;
+            if (q > hi) q = hi;
+            qs[j] = (char) q;
+            s[j] = (rngf () < nrate) ? "Nn"[rng () % 2] : "ACGT"[rng () % 4];
+        }
+        s[len] = qs[len] = 0;
+
+        rs->rec[i].name.s = "read";
+        rs->rec[i].name.l = 4;
+        rs->rec[i].seq.s = s;
+        rs->rec[i].seq.l = len;
+        rs->rec[i].qual.s = qs;
+        rs->rec[i].qual.l = len;
+    }
+}
+
+static void free_reads (read_set *rs) {
+    free (rs->rec);
+    free (rs->cut);
+    free (rs->seq);
+    free (rs->qual);
+}
+
+static double now (void) {
+    struct timespec t;
+
+    clock_gettime (CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+/* ---- benchmark ---- */
+
+/* implementations: the scalar search, each kernel on its own, and the
+   full per-read and batch entry points (window size fixed at 0.1) */
+enum { IMPL_SCALAR, IMPL_KERNEL, IMPL_WINDOW = IMPL_KERNEL + NKERNELS, IMPL_BATCH, NIMPLS };
+
+static double time_impl (int impl, read_set *rs, int ws, int thr, int rounds) {
+    sliding_kernel k = (impl >= IMPL_KERNEL && impl < IMPL_WINDOW) ? sliding_get_kernel (kernel_names[impl - IMPL_KERNEL]) : NULL;
+    sliding_batch_fn batch = sliding_select_batch (SANGER, 0, 0, 0);
+    double t0;
+    int r, i, f, t;
+    volatile int sink = 0;
+
+    t0 = now ();
+    for (r = 0; r < rounds; r++) {
+        switch (impl) {
+        case IMPL_SCALAR:
+            for (i = 0; i < rs->n; i++) {
+                sink += sliding_scalar (&rs->rec[i], SANGER, 0, ws, thr, 0, 0, &f, &t) + f + t;
+            }
+            break;
+
+        case IMPL_WINDOW:
+            for (i = 0; i < rs->n; i++) {
+                rs->cut[i] = sliding_window (&rs->rec[i], SANGER, 0, thr, 0, 0, 0, 0);
+            }
+            break;
+
+        case IMPL_BATCH:
+            batch (rs->rec, rs->n, rs->cut, 0, thr);
+            break;
+
+        default:
+            for (i = 0; i < rs->n; i++) {
+                sink += k (rs->rec[i].qual.s, rs->len, ws, 33, 33, 126, 1, thr, 0, &f, &t) + f + t;
+            }
+        }
+    }
+    return now () - t0;
+}
+
+static int run_bench (long bases) {
+    static const char *impl_names[NIMPLS] = {"scalar", "sse4.2", "avx2", "avx512", "sliding_window", "batch"};
+    read_set rs;
+    size_t li, fi, di;
+    int impl, n, ws, rounds;
+    double t;
+
+    printf ("impl\tlength\twindow_frac\tquality\treads\tns_per_base\tns_per_read\n");
+    for (li = 0; li < NLENGTHS; li++) {
+        for (di = 0; di < NDISTS; di++) {
+            /* about a million bases per batch, repeated up to the total */
+            n = 1000000 / lengths[li];
+            if (n < 4) n = 4;
+            rounds = (int) (bases / ((long) n * lengths[li]));
+            if (rounds < 1) rounds = 1;
+            make_reads (&rs, n, lengths[li], &dists[di], SANGER, 0.001);
+
+            for (fi = 0; fi < NFRACTIONS; fi++) {
+                ws = (int) (fractions[fi] * lengths[li]);
+                if (ws == 0) ws = lengths[li];
+
+                for (impl = 0; impl < NIMPLS; impl++) {
+                    if (impl >= IMPL_KERNEL && impl < IMPL_WINDOW && !sliding_get_kernel (kernel_names[impl - IMPL_KERNEL])) continue;
+                    /* the entry points always use a tenth of the read */
+                    if (impl >= IMPL_WINDOW && fractions[fi] != 0.1) continue;
+
+                    t = time_impl (impl, &rs, ws, 20, rounds);
+                    printf ("%s\t%d\t%.2f\t%s\t%ld\t%.3f\t%.1f\n", impl_names[impl], lengths[li], fractions[fi], dists[di].name,
+                        (long) n * rounds, t * 1e9 / ((double) n * rounds * lengths[li]), t * 1e9 / ((double) n * rounds));
+                    fflush (stdout);
+                }
+            }
+            free_reads (&rs);
+        }
+    }
+    return EXIT_SUCCESS;
+}
+
+/* ---- fuzzing ---- */
+
+static long failures = 0;
+
+static void report (const char *impl, read_set *rs, int i, const char *settings, int f0, int t0, int f1, int t1) {
+    if (failures++ >= 10) return;
+    printf ("MISMATCH %s: %s len=%d\n  qual=%.*s\n  reference %d,%d got %d,%d\n", impl, settings, rs->len,
+        rs->len > 200 ? 200 : rs->len, rs->rec[i].qual.s, f0, t0, f1, t1);
+}
+
+static void fuzz_one (void) {
+    int qualtype = 1 + rng () % 3;     /* SANGER, SOLEXA, ILLUMINA */
+    int len = (rng () % 8) ? 1 + rng () % 300 : ((rng () % 4) ? 1 + rng () % 5000 : 35 + rng () % 100000);
+    int n = (len > 5000) ? 1 : 1 + rng () % 16;
+    int thr = (rng () % 4) ? rng () % 42 : rng () % 200;
+    int lthr = (rng () % 2) ? rng () % 60 : 0;
+    int no5 = rng () % 2, trunc_n = rng () % 2;
+    double frac = (rng () % 2) ? 0.1 : 0.01 + rngf ();
+    int ws = (int) (frac * len), wr = (int) (0.1 * len);
+    int i, j, f0, t0, f1, t1, found0, found1;
+    sliding_kernel saved_kernel = kernel, k;
+    sliding_range saved_range = range;
+    sliding_batch_fn batch = sliding_select_batch (qualtype, no5, trunc_n, 0);
+    quality_dist d = dists[rng () % NDISTS];
+    cutsites *ref;
+    read_set rs;
+    char settings[128];
+
+    if (ws == 0) ws = len;
+    if (ws > len) ws = len;
+    if (wr == 0) wr = len;
+    d.start += rng () % 10;
+    make_reads (&rs, n, len, &d, qualtype, (rng () % 2) ? 0 : 0.01);
+    snprintf (settings, sizeof settings, "qualtype=%s q=%d l=%d x=%d n=%d ws=%d", typenames[qualtype], thr, lthr, no5, trunc_n, ws);
+
+    for (i = 0; i < n; i++) {
+        /* each kernel against the scalar search, at any window size */
+        found0 = sliding_scalar (&rs.rec[i], qualtype, 0, ws, thr, no5, 0, &f0, &t0);
+        for (j = 0; j < NKERNELS && qualtype != SOLEXA; j++) {
+            if (!(k = sliding_get_kernel (kernel_names[j]))) continue;
+            f1 = t1 = -7;
+            found1 = k (rs.rec[i].qual.s, len, ws, quality_constants[qualtype][Q_OFFSET], quality_constants[qualtype][Q_MIN],
+                quality_constants[qualtype][Q_MAX], 1, thr, no5, &f1, &t1);
+            if (found1 != found0 || f1 != f0 || t1 != t0) report (kernel_names[j], &rs, i, settings, f0, t0, f1, t1);
+        }
+    }
+
+    /* the entry points against a purely scalar sliding_search() */
+    ref = (cutsites *) malloc (n * sizeof (cutsites));
+    kernel = NULL;
+    range = NULL;
+    for (i = 0; i < n; i++) ref[i] = sliding_search (&rs.rec[i], qualtype, 0, lthr, thr, no5, trunc_n, 0);
+    kernel = saved_kernel;
+    range = saved_range;
+
+    snprintf (settings, sizeof settings, "qualtype=%s q=%d l=%d x=%d n=%d ws=%d", typenames[qualtype], thr, lthr, no5, trunc_n, wr);
+    for (i = 0; i < n; i++) {
+        cutsites c = sliding_window (&rs.rec[i], qualtype, lthr, thr, no5, trunc_n, 0, 0);
+        if (c.five_prime_cut != ref[i].five_prime_cut || c.three_prime_cut != ref[i].three_prime_cut)
+            report ("sliding_window", &rs, i, settings, ref[i].five_prime_cut, ref[i].three_prime_cut, c.five_prime_cut, c.three_prime_cut);
+    }
+    batch (rs.rec, n, rs.cut, lthr, thr);
+    for (i = 0; i < n; i++) {
+        if (rs.cut[i].five_prime_cut != ref[i].five_prime_cut || rs.cut[i].three_prime_cut != ref[i].three_prime_cut)
+            report ("batch", &rs, i, settings, ref[i].five_prime_cut, ref[i].three_prime_cut, rs.cut[i].five_prime_cut, rs.cut[i].three_prime_cut);
+    }
+
+    free (ref);
+    free_reads (&rs);
+}
+
+static int run_fuzz (long iterations) {
+    long it;
+    int j;
+
+    pthread_once (&kernel_once, sliding_init);
+    printf ("kernels:");
+    for (j = 0; j < NKERNELS; j++) {
+        if (sliding_get_kernel (kernel_names[j])) printf (" %s", kernel_names[j]);
+    }
+    printf ("\n");
+
+    for (it = 0; it < iterations; it++) fuzz_one ();
+
+    printf ("%ld cases, %ld mismatches\n", iterations, failures);
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+int main (int argc, char *argv[]) {
+    long bases = 20000000, iterations = 100000;
+    int optc;
+
+    if (argc < 2 || (strcmp (argv[1], "bench") && strcmp (argv[1], "fuzz"))) {
+        fprintf (stderr, "\nUsage: kernels bench [-b bases per setting] [-s seed]\n       kernels fuzz [-i iterations] [-s seed]\n\n");
+        return EXIT_FAILURE;
+    }
+
+    optind = 2;
+    while ((optc = getopt (argc, argv, "b:i:s:")) != -1) {
+        switch (optc) {
+        case 'b':
+            bases = atol (optarg);
+            break;
+        case 'i':
+            iterations = atol (optarg);
+            break;
+        case 's':
+            rng_state ^= strtoull (optarg, NULL, 10) * 0x9E3779B97F4A7C15ULL;
+            break;
+        default:
+            return EXIT_FAILURE;
+        }
+    }
+
+    pthread_once (&kernel_once, sliding_init);
+    if (!strcmp (argv[1], "bench")) return run_bench (bases);
+    return run_fuzz (iterations);
+}
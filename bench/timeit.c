@@ -0,0 +1,62 @@
+/* timeit: run a command and write its wall-clock time, CPU time and peak
+   resident set size to a file, as one tab-separated line:
+
+     <wall seconds> <user seconds> <system seconds> <peak RSS in KB> <exit status>
+
+   The command's own output is left alone. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+static double seconds (struct timeval tv) {
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+int main (int argc, char *argv[]) {
+    struct timespec t0, t1;
+    struct rusage ru;
+    FILE *out;
+    pid_t pid;
+    int status;
+
+    if (argc < 3) {
+        fprintf(stderr, "\nUsage: timeit <result file> <command> [arguments]\n\n");
+        return EXIT_FAILURE;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        return EXIT_FAILURE;
+    }
+    if (pid == 0) {
+        execvp(argv[2], argv + 2);
+        perror(argv[2]);
+        _exit(127);
+    }
+    if (wait4(pid, &status, 0, &ru) < 0) {
+        perror("wait4");
+        return EXIT_FAILURE;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    out = fopen(argv[1], "w");
+    if (!out) {
+        fprintf(stderr, "****Error: Could not open result file '%s'.\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+    fprintf(out, "%.3f\t%.3f\t%.3f\t%ld\t%d\n",
+        (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9,
+        seconds(ru.ru_utime), seconds(ru.ru_stime), ru.ru_maxrss,
+        WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status));
+    fclose(out);
+
+    return WIFEXITED(status) ? WEXITSTATUS(status) : EXIT_FAILURE;
+}
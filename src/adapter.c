@@ -0,0 +1,285 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include "sickle.h"
+#include "kseq.h"
+#include "adapter.h"
+
+/* Like the window search, the matcher is forced inline into one copy
+   built for the popcnt instruction and one for any CPU. */
+#if defined(__GNUC__)
+#define ADAPTER_INLINE static inline __attribute__((always_inline))
+#else
+#define ADAPTER_INLINE static inline
+#endif
+
+/* shortest overlap of two mates that counts, and the bases per allowed mismatch in it */
+#define ADAPTER_MATE_OVERLAP 30
+#define ADAPTER_MATE_BASES_PER_MISMATCH 10
+
+/* reads up to this long get their bit sets on the stack */
+#define ADAPTER_STACK_BASES 1024
+
+/* A sequence of length len is stored as four bit sets, one per base:
+   bit j of set c (bits[c * stride + j / 64], bit j % 64) is set when
+   base j is c. stride has one word more than the sequence needs, left
+   zero, so that 64 bits can be read from any position in it. Ns and
+   other characters are in no set, so they never match. */
+#define ADAPTER_STRIDE(len) (((len) + 63) / 64 + 1)
+
+typedef void (*adapter_locate_fn) (const adapter_set *a, kseq_t *recs, int n, int paired, adapter_clip *clip);
+
+static adapter_locate_fn locate;
+
+ADAPTER_INLINE int adapter_base (char c) {
+    switch (c) {
+    case 'A': case 'a': return 0;
+    case 'C': case 'c': return 1;
+    case 'G': case 'g': return 2;
+    case 'T': case 't': return 3;
+    }
+    return -1;
+}
+
+/* the bit sets of s[0, len), or of its reverse complement if rc is set */
+ADAPTER_INLINE void adapter_bits (const char *s, int len, int rc, uint64_t *bits) {
+    int stride = ADAPTER_STRIDE (len), j, c;
+
+    memset (bits, 0, 4 * stride * sizeof (uint64_t));
+    for (j = 0; j < len; j++) {
+        c = adapter_base (rc ? s[len - 1 - j] : s[j]);
+        if (c < 0) continue;
+        if (rc) c = 3 - c;
+        bits[c * stride + (j >> 6)] |= 1ULL << (j & 63);
+    }
+}
+
+/* 64 bits of a bit set, from bit off on */
+ADAPTER_INLINE uint64_t adapter_word (const uint64_t *w, int off) {
+    int i = off >> 6, s = off & 63;
+
+    return s ? (w[i] >> s) | (w[i + 1] << (64 - s)) : w[i];
+}
+
+/* The mismatches between a[0, m) and b[off, off + m), a 64 bases at a
+   time; gives up as soon as there are more than limit. A base matches
+   in exactly one of the four sets, so the matches of all four can be
+   counted together. */
+ADAPTER_INLINE int adapter_mismatches (const uint64_t *a, int astride, const uint64_t *b, int bstride, int off, int m, int limit) {
+    uint64_t same, mask;
+    int j, c, k, mism = 0;
+
+    for (j = 0; j < m; j += 64) {
+        k = (m - j < 64) ? m - j : 64;
+        mask = (k == 64) ? ~0ULL : (1ULL << k) - 1;
+        same = 0;
+        for (c = 0; c < 4; c++) same |= a[c * astride + (j >> 6)] & adapter_word (b + c * bstride, off + j);
+        mism += k - __builtin_popcountll (same & mask);
+        if (mism > limit) break;
+    }
+    return mism;
+}
+
+/* where the leftmost adapter starts in a read of length len, or len */
+ADAPTER_INLINE int adapter_find (const adapter_set *a, const uint64_t *bits, int len) {
+    int best = len, i, p, m, alen, overlap, limit;
+
+    for (i = 0; i < a->n; i++) {
+        alen = a->len[i];
+        overlap = (a->min_overlap < alen) ? a->min_overlap : alen;
+        for (p = 0; p <= len - overlap && p < best; p++) {
+            m = (len - p < alen) ? len - p : alen;
+            limit = a->mismatches * m / alen;
+            if (adapter_mismatches (a->bits[i], ADAPTER_STRIDE (alen), bits, ADAPTER_STRIDE (len), p, m, limit) <= limit) {
+                best = p;
+                break;
+            }
+        }
+    }
+    return best;
+}
+
+/* The insert length of a pair whose reads run past the insert into the
+   adapters, or -1: the forward read then starts with the insert, and
+   the reverse complement of its mate ends with it. */
+ADAPTER_INLINE int adapter_insert (const uint64_t *fwd, int l1, const uint64_t *rc, int l2) {
+    int o, m, limit;
+
+    for (o = 1; o <= l2 - ADAPTER_MATE_OVERLAP; o++) {
+        m = (l1 < l2 - o) ? l1 : l2 - o;
+        if (m < ADAPTER_MATE_OVERLAP) break;
+        limit = m / ADAPTER_MATE_BASES_PER_MISMATCH;
+        if (adapter_mismatches (fwd, ADAPTER_STRIDE (l1), rc, ADAPTER_STRIDE (l2), o, m, limit) <= limit) return l2 - o;
+    }
+    return -1;
+}
+
+/* bit sets for a read of length len: the stack buffer if it is large enough, else a new one */
+static uint64_t *adapter_buffer (uint64_t *stack, int len, uint64_t **heap) {
+    if (len <= ADAPTER_STACK_BASES) return stack;
+    *heap = (uint64_t *) realloc (*heap, 4 * ADAPTER_STRIDE (len) * sizeof (uint64_t));
+    return *heap;
+}
+
+ADAPTER_INLINE void adapter_locate_body (const adapter_set *a, kseq_t *recs, int n, int paired, adapter_clip *clip) {
+    uint64_t stack1[4 * ADAPTER_STRIDE (ADAPTER_STACK_BASES)], stack2[4 * ADAPTER_STRIDE (ADAPTER_STACK_BASES)];
+    uint64_t *heap1 = NULL, *heap2 = NULL, *b1, *b2;
+    int i, l1, l2, insert;
+
+    for (i = 0; i < n; i++) {
+        l1 = recs[i].seq.l;
+        b1 = adapter_buffer (stack1, l1, &heap1);
+        adapter_bits (recs[i].seq.s, l1, 0, b1);
+        clip[i].pos = adapter_find (a, b1, l1);
+        if (!paired) continue;
+
+        /* the mate: its own adapter, then the two laid over each other */
+        l2 = recs[i + 1].seq.l;
+        b2 = adapter_buffer (stack2, l2, &heap2);
+        adapter_bits (recs[i + 1].seq.s, l2, 0, b2);
+        clip[i + 1].pos = adapter_find (a, b2, l2);
+
+        adapter_bits (recs[i + 1].seq.s, l2, 1, b2);
+        insert = adapter_insert (b1, l1, b2, l2);
+        if (insert >= 0) {
+            if (insert < clip[i].pos) clip[i].pos = insert;
+            if (insert < clip[i + 1].pos) clip[i + 1].pos = insert;
+        }
+        i++;
+    }
+
+    free (heap1);
+    free (heap2);
+}
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+__attribute__((target ("popcnt")))
+static void adapter_locate_popcnt (const adapter_set *a, kseq_t *recs, int n, int paired, adapter_clip *clip) {
+    adapter_locate_body (a, recs, n, paired, clip);
+}
+#endif
+
+static void adapter_locate_generic (const adapter_set *a, kseq_t *recs, int n, int paired, adapter_clip *clip) {
+    adapter_locate_body (a, recs, n, paired, clip);
+}
+
+adapter_set *adapter_init (int mismatches, int min_overlap, int after) {
+    adapter_set *a = (adapter_set *) calloc (1, sizeof (adapter_set));
+
+    a->mismatches = mismatches;
+    a->min_overlap = (min_overlap > 0) ? min_overlap : 1;
+    a->after = after;
+
+    locate = adapter_locate_generic;
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    __builtin_cpu_init ();
+    if (__builtin_cpu_supports ("popcnt")) locate = adapter_locate_popcnt;
+#endif
+    return a;
+}
+
+/* Add an adapter sequence; returns -1, after reporting it, if it is
+   empty or not all A, C, G and T, else 0. */
+int adapter_add (adapter_set *a, const char *seq) {
+    size_t len = strlen (seq), j;
+    char *s;
+
+    for (j = 0; j < len && adapter_base (seq[j]) >= 0; j++);
+    if (len == 0 || j < len) {
+        fprintf (stderr, "****Error: Adapter '%s' must be a sequence of A, C, G and T.\n\n", seq);
+        return -1;
+    }
+
+    s = (char *) malloc (len + 1);
+    for (j = 0; j <= len; j++) s[j] = toupper ((unsigned char) seq[j]);
+
+    a->seq = (char **) realloc (a->seq, (a->n + 1) * sizeof (char *));
+    a->len = (int *) realloc (a->len, (a->n + 1) * sizeof (int));
+    a->bits = (uint64_t **) realloc (a->bits, (a->n + 1) * sizeof (uint64_t *));
+    a->seq[a->n] = s;
+    a->len[a->n] = len;
+    a->bits[a->n] = (uint64_t *) malloc (4 * ADAPTER_STRIDE (len) * sizeof (uint64_t));
+    adapter_bits (s, len, 0, a->bits[a->n]);
+    a->n++;
+    return 0;
+}
+
+void adapter_destroy (adapter_set *a) {
+    int i;
+
+    if (!a) return;
+
+    for (i = 0; i < a->n; i++) {
+        free (a->seq[i]);
+        free (a->bits[i]);
+    }
+    free (a->seq);
+    free (a->len);
+    free (a->bits);
+    polytail_destroy (a->poly);
+    free (a);
+}
+
+/* Find where the adapter or poly tail of each of the n records starts,
+   into clip[].pos. With paired set, recs holds pairs of mates. */
+void adapter_locate (const adapter_set *a, kseq_t *recs, int n, int paired, adapter_clip *clip) {
+    int i, t;
+
+    if (a->n) locate (a, recs, n, paired, clip);
+    else for (i = 0; i < n; i++) clip[i].pos = recs[i].seq.l;
+
+    if (!a->poly) return;
+    for (i = 0; i < n; i++) {
+        t = polytail_find (a->poly, recs[i].seq.s, recs[i].seq.l);
+        if (t < clip[i].pos) clip[i].pos = t;
+    }
+}
+
+/* Cut every record short at its clip position for the quality
+   trimming, ending the sequence with a NUL so that the N search stops
+   there too. */
+void adapter_hide (kseq_t *recs, int n, adapter_clip *clip) {
+    kseq_t *r;
+    int i;
+
+    for (i = 0; i < n; i++) {
+        r = &recs[i];
+        clip[i].seq_l = r->seq.l;
+        clip[i].qual_l = r->qual.l;
+        if (clip[i].pos >= (int) r->seq.l) continue;
+
+        clip[i].saved = r->seq.s[clip[i].pos];
+        r->seq.s[clip[i].pos] = '\0';
+        r->seq.l = clip[i].pos;
+        if (r->qual.l > r->seq.l) r->qual.l = r->seq.l;
+    }
+}
+
+void adapter_restore (kseq_t *recs, int n, const adapter_clip *clip) {
+    kseq_t *r;
+    int i;
+
+    for (i = 0; i < n; i++) {
+        r = &recs[i];
+        if (clip[i].pos < clip[i].seq_l) r->seq.s[clip[i].pos] = clip[i].saved;
+        r->seq.l = clip[i].seq_l;
+        r->qual.l = clip[i].qual_l;
+    }
+}
+
+/* Clip the quality-trimmed reads at their adapters, and discard those
+   left shorter than length_threshold. */
+void adapter_apply (cutsites *cut, int n, const adapter_clip *clip, int length_threshold) {
+    int i;
+
+    for (i = 0; i < n; i++) {
+        if (cut[i].three_prime_cut < 0 || clip[i].pos >= cut[i].three_prime_cut) continue;
+
+        cut[i].three_prime_cut = clip[i].pos;
+        if (cut[i].three_prime_cut - cut[i].five_prime_cut < length_threshold) {
+            cut[i].three_prime_cut = -1;
+            cut[i].five_prime_cut = -1;
+        }
+    }
+}
@@ -0,0 +1,61 @@
+#ifndef ADAPTER_H
+#define ADAPTER_H
+
+#include <stdint.h>
+#include "sickle.h"
+#include "polytail.h"
+
+/* Adapter trimming in the same pass as the quality trimming. Each read
+   is searched for the 3' adapters given with --adapter: the adapter may
+   start anywhere in the read and run off its end, so only its first
+   bases need to be there (at least min_overlap of them). A match may
+   have up to mismatches mismatches over the whole adapter, and
+   proportionally fewer over a shorter overlap. The leftmost match wins.
+
+   For paired-end reads the mates are also laid over each other: when
+   the insert is shorter than a read, the start of the forward read
+   matches the end of the reverse complement of its mate, and both
+   reads are clipped at the insert length, even where the adapter
+   itself has too many errors to be found.
+
+   Reads and adapters are compared as bit sets, one per base, so that
+   64 positions are compared with a few ANDs and a popcount.
+
+   Poly-G (or other poly-X) tails found by polytail.h are clipped in the
+   same pass: a read is clipped at its adapter or at its tail, whichever
+   comes first. The set then may hold no adapters at all.
+
+   The clip is applied either before the quality trimming (the window
+   search only sees the read up to the adapter; adapter_hide() and
+   adapter_restore() shorten the records in place while it runs) or
+   after it (adapter_apply() moves the 3' cut in and applies the length
+   threshold again). */
+
+/* where a record's adapter starts, and what adapter_hide() changed */
+typedef struct {
+    int pos;        /* 3' clip position, the read's length if nothing is clipped */
+    int seq_l;      /* lengths before adapter_hide() */
+    int qual_l;
+    char saved;     /* the character overwritten by the NUL that ends the hidden read */
+} adapter_clip;
+
+typedef struct {
+    int n;
+    char **seq;
+    int *len;
+    uint64_t **bits;    /* each adapter as bit sets (see adapter.c) */
+    int mismatches;
+    int min_overlap;
+    int after;          /* clip after the quality trimming instead of before */
+    polytail *poly;     /* poly tails to clip as well, or NULL */
+} adapter_set;
+
+adapter_set *adapter_init (int mismatches, int min_overlap, int after);
+int adapter_add (adapter_set *a, const char *seq);
+void adapter_destroy (adapter_set *a);
+void adapter_locate (const adapter_set *a, kseq_t *recs, int n, int paired, adapter_clip *clip);
+void adapter_hide (kseq_t *recs, int n, adapter_clip *clip);
+void adapter_restore (kseq_t *recs, int n, const adapter_clip *clip);
+void adapter_apply (cutsites *cut, int n, const adapter_clip *clip, int length_threshold);
+
+#endif /* ADAPTER_H */
@@ -0,0 +1,372 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <getopt.h>
+#include <pthread.h>
+#include "sickle.h"
+#include "lanes.h"
+#include "gzwriter.h"
+#include "batch.h"
+#include "profile.h"
+
+/* samples trimmed at the same time unless -j says otherwise */
+#define BATCH_JOBS 4
+
+/* the columns of the sample sheet */
+enum {
+  SHEET_SAMPLE,
+  SHEET_MODE,
+  SHEET_INPUT1,
+  SHEET_INPUT2,
+  SHEET_OUTPUT1,
+  SHEET_OUTPUT2,
+  SHEET_SINGLE,
+  SHEET_OPTIONS,
+  SHEET_COLUMNS
+};
+
+struct __batch_ {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int running;
+};
+
+static struct option batch_long_options[] = {
+    {"threads", required_argument, 0, 'T'},
+    {"jobs", required_argument, 0, 'j'},
+    {"stats", required_argument, 0, 'o'},
+    {"profile", optional_argument, 0, PROFILE_OPTION},
+    {GETOPT_HELP_OPTION_DECL},
+    {GETOPT_VERSION_OPTION_DECL},
+    {NULL, 0, NULL, 0}
+};
+
+void batch_usage (int status, char *msg) {
+
+    fprintf(stderr, "\nUsage: %s batch [options] <sample sheet> [-- <se/pe options for every sample>]\n\
+\n\
+The sample sheet is tab-separated, one sample per line (lines starting with # are skipped):\n\
+\n\
+sample  mode  input1  input2  output1  output2  single  options\n\
+\n\
+mode is se or pe. Unused columns are left empty or set to '.':\n\
+  se                  input1 -> output1\n\
+  pe                  input1, input2 -> output1, output2 and single\n\
+  pe, interleaved     input1 -> output1 (and single; without it, as with -M)\n\
+options are further se or pe options for the sample, separated by spaces.\n\
+\n\
+Options:\n\
+-T, --threads, Number of trimming threads shared by all the samples. Default 1.\n\
+-j, --jobs, Number of samples trimmed at the same time. Default %d.\n\
+-o, --stats, Write the per-sample counts to this file instead of standard output.\n\
+--profile[=FILE], Report the time spent in each stage over all the samples to stderr, or as JSON to FILE.\n\
+--help, display this help and exit\n\
+--version, output version information and exit\n\n", PROGRAM_NAME, BATCH_JOBS);
+
+    if (msg) fprintf(stderr, "%s\n\n", msg);
+    exit(status);
+}
+
+static void batch_sheet_error (const char *sheet, int line, const char *msg) {
+    fprintf(stderr, "****Error: Sample sheet '%s', line %d: %s\n\n", sheet, line, msg);
+    exit(EXIT_FAILURE);
+}
+
+/* a sheet cell, or NULL if it is empty or '.' */
+static char *batch_cell (char **cols, int ncols, int k) {
+    if (k >= ncols || !cols[k][0] || !strcmp(cols[k], ".")) return NULL;
+    return cols[k];
+}
+
+static void batch_arg (batch_sample *s, const char *arg) {
+    s->argv = (char **) realloc(s->argv, (s->argc + 2) * sizeof(char *));
+    s->argv[s->argc++] = strdup(arg);
+    s->argv[s->argc] = NULL;
+}
+
+static void batch_path (batch_sample *s, const char *opt, const char *path, const char *sheet, int line) {
+    lanes *l;
+
+    if (IS_STDIO(path)) batch_sheet_error(sheet, line, "Standard input and output cannot be used in a batch.");
+    batch_arg(s, opt);
+    batch_arg(s, path);
+
+    /* an input can be several lane files */
+    if (opt[1] == 'f' || opt[1] == 'r' || opt[1] == 'c') {
+        l = lanes_init(1);
+        lanes_add(l, 0, path);
+        s->size += lanes_size(l);
+        lanes_close(l);
+    }
+}
+
+/* Turn a line of the sheet into the se or pe command line of its sample:
+   the paths as options, then the sample's own options, then the ones
+   for every sample. The line is split up in place. */
+static void batch_parse_line (batch_sample *s, char *text, char **common, int ncommon, const char *sheet, int line) {
+    char *cols[SHEET_COLUMNS] = {NULL}, *c, *mode, *in2, *out2, *single, *opt;
+    int ncols = 0, k;
+
+    text[strcspn(text, "\r\n")] = '\0';
+    for (c = text; ncols < SHEET_COLUMNS; c++) {
+        cols[ncols++] = c;
+        /* the options are the rest of the line, tabs and all */
+        if (ncols == SHEET_COLUMNS || !(c = strchr(c, '\t'))) break;
+        *c = '\0';
+    }
+
+    memset(s, 0, sizeof(batch_sample));
+    if (!batch_cell(cols, ncols, SHEET_SAMPLE)) batch_sheet_error(sheet, line, "The sample has no name.");
+    s->name = strdup(cols[SHEET_SAMPLE]);
+
+    mode = batch_cell(cols, ncols, SHEET_MODE);
+    if (!mode || (strcmp(mode, "se") && strcmp(mode, "pe"))) batch_sheet_error(sheet, line, "The mode must be se or pe.");
+    s->paired = !strcmp(mode, "pe");
+
+    if (!batch_cell(cols, ncols, SHEET_INPUT1) || !batch_cell(cols, ncols, SHEET_OUTPUT1)) {
+        batch_sheet_error(sheet, line, "The sample needs an input1 and an output1.");
+    }
+    in2 = batch_cell(cols, ncols, SHEET_INPUT2);
+    out2 = batch_cell(cols, ncols, SHEET_OUTPUT2);
+    single = batch_cell(cols, ncols, SHEET_SINGLE);
+
+    batch_arg(s, PROGRAM_NAME);
+    batch_arg(s, mode);
+
+    if (!s->paired) {
+        if (in2 || out2 || single) batch_sheet_error(sheet, line, "A single-end sample only has an input1 and an output1.");
+        batch_path(s, "-f", cols[SHEET_INPUT1], sheet, line);
+        batch_path(s, "-o", cols[SHEET_OUTPUT1], sheet, line);
+    } else if (in2) {
+        if (!out2 || !single) batch_sheet_error(sheet, line, "A paired-end sample with two inputs needs output1, output2 and single.");
+        batch_path(s, "-f", cols[SHEET_INPUT1], sheet, line);
+        batch_path(s, "-r", in2, sheet, line);
+        batch_path(s, "-o", cols[SHEET_OUTPUT1], sheet, line);
+        batch_path(s, "-p", out2, sheet, line);
+        batch_path(s, "-s", single, sheet, line);
+    } else {
+        if (out2) batch_sheet_error(sheet, line, "An interleaved paired-end sample has no output2.");
+        batch_path(s, "-c", cols[SHEET_INPUT1], sheet, line);
+        batch_path(s, single ? "-m" : "-M", cols[SHEET_OUTPUT1], sheet, line);
+        if (single) batch_path(s, "-s", single, sheet, line);
+    }
+
+    if ((opt = batch_cell(cols, ncols, SHEET_OPTIONS))) {
+        for (opt = strtok(opt, " \t"); opt; opt = strtok(NULL, " \t")) batch_arg(s, opt);
+    }
+    for (k = 0; k < ncommon; k++) batch_arg(s, common[k]);
+}
+
+/* read the sheet; exits on any line it cannot use */
+static batch_sample *batch_read_sheet (const char *sheet, char **common, int ncommon, int *nsamples) {
+    batch_sample *samples = NULL;
+    FILE *fp;
+    char *text = NULL;
+    size_t cap = 0;
+    int n = 0, line = 0;
+
+    fp = fopen(sheet, "r");
+    if (!fp) {
+        fprintf(stderr, "****Error: Could not open sample sheet '%s'.\n\n", sheet);
+        exit(EXIT_FAILURE);
+    }
+
+    while (getline(&text, &cap, fp) > 0) {
+        line++;
+        if (text[0] == '#' || text[strspn(text, " \t\r\n")] == '\0') continue;
+        samples = (batch_sample *) realloc(samples, (n + 1) * sizeof(batch_sample));
+        batch_parse_line(&samples[n++], text, common, ncommon, sheet, line);
+    }
+    free(text);
+    fclose(fp);
+
+    if (n == 0) {
+        fprintf(stderr, "****Error: Sample sheet '%s' has no samples.\n\n", sheet);
+        exit(EXIT_FAILURE);
+    }
+    *nsamples = n;
+    return samples;
+}
+
+/* the sample has read its options: getopt is free for the next one */
+void batch_started (batch_sample *s) {
+    pthread_mutex_lock(&s->owner->lock);
+    s->started = 1;
+    pthread_cond_broadcast(&s->owner->cond);
+    pthread_mutex_unlock(&s->owner->lock);
+}
+
+static void *batch_sample_thread (void *data) {
+    batch_sample *s = (batch_sample *) data;
+    batch *b = s->owner;
+
+    s->start = profile_clock();
+    s->status = s->paired ? paired_run(s->argc, s->argv, s) : single_run(s->argc, s->argv, s);
+    s->stop = profile_clock();
+
+    pthread_mutex_lock(&b->lock);
+    s->started = 1;
+    b->running--;
+    pthread_cond_broadcast(&b->cond);
+    pthread_mutex_unlock(&b->lock);
+    return NULL;
+}
+
+/* the largest inputs first, then in sheet order */
+static int batch_by_size (const void *a, const void *b) {
+    const batch_sample *x = *(const batch_sample **) a, *y = *(const batch_sample **) b;
+
+    if (x->size != y->size) return (x->size < y->size) ? 1 : -1;
+    return (x < y) ? -1 : (x > y);
+}
+
+int batch_main (int argc, char *argv[]) {
+    int optc;
+    extern char *optarg;
+    int threads = 1;
+    int jobs = BATCH_JOBS;
+    char *stats_path = NULL;
+    char *profile_path = NULL;
+    char *sheet;
+    batch_sample *samples, **order;
+    pthread_t *tids;
+    jobpool *pool;
+    batch b;
+    FILE *stats = stdout;
+    int nsamples;
+    int failed = 0;
+    int i, k;
+
+    while (1) {
+        int option_index = 0;
+        optc = getopt_long(argc, argv, "T:j:o:", batch_long_options, &option_index);
+
+        if (optc == -1)
+            break;
+
+        switch (optc) {
+        case 'T':
+            threads = atoi(optarg);
+            if (threads < 1) {
+                fprintf(stderr, "Number of threads must be >= 1\n");
+                return EXIT_FAILURE;
+            }
+            break;
+
+        case 'j':
+            jobs = atoi(optarg);
+            if (jobs < 1) {
+                fprintf(stderr, "Number of jobs must be >= 1\n");
+                return EXIT_FAILURE;
+            }
+            break;
+
+        case 'o':
+            stats_path = optarg;
+            break;
+
+        case PROFILE_OPTION:
+            profile_begin();
+            profile_path = optarg;
+            break;
+
+        case_GETOPT_HELP_CHAR(batch_usage)
+        case_GETOPT_VERSION_CHAR(PROGRAM_NAME, VERSION, AUTHORS);
+
+        case '?':
+            batch_usage(EXIT_FAILURE, NULL);
+            break;
+
+        default:
+            batch_usage(EXIT_FAILURE, NULL);
+            break;
+        }
+    }
+
+    /* argv[optind] is "batch"; the sheet follows it, and everything after it goes to every sample */
+    if (optind + 1 >= argc) batch_usage(EXIT_FAILURE, "****Error: Must have a sample sheet.");
+    sheet = argv[optind + 1];
+    samples = batch_read_sheet(sheet, argv + optind + 2, argc - optind - 2, &nsamples);
+
+    if (stats_path) {
+        stats = fopen(stats_path, "w");
+        if (!stats) {
+            fprintf(stderr, "****Error: Could not open output file '%s'.\n\n", stats_path);
+            return EXIT_FAILURE;
+        }
+    }
+
+    pthread_mutex_init(&b.lock, NULL);
+    pthread_cond_init(&b.cond, NULL);
+    b.running = 0;
+    pool = jobpool_init(threads);
+    gzwriter_pool_hold(threads);
+
+    order = (batch_sample **) malloc(nsamples * sizeof(batch_sample *));
+    for (i = 0; i < nsamples; i++) {
+        samples[i].owner = &b;
+        samples[i].pool = pool;
+        order[i] = &samples[i];
+    }
+    qsort(order, nsamples, sizeof(batch_sample *), batch_by_size);
+
+    /* Start the samples one after another as others finish. Each one
+       reads its options with getopt, which keeps its state in globals,
+       so the next one starts only once that is done. */
+    tids = (pthread_t *) malloc(nsamples * sizeof(pthread_t));
+    for (k = 0; k < nsamples; k++) {
+        pthread_mutex_lock(&b.lock);
+        while (b.running >= jobs) pthread_cond_wait(&b.cond, &b.lock);
+        b.running++;
+        pthread_mutex_unlock(&b.lock);
+
+        optind = 0;
+        if (pthread_create(&tids[k], NULL, batch_sample_thread, order[k]) != 0) {
+            fprintf(stderr, "****Error: Could not start sample thread.\n\n");
+            exit(EXIT_FAILURE);
+        }
+
+        pthread_mutex_lock(&b.lock);
+        while (!order[k]->started) pthread_cond_wait(&b.cond, &b.lock);
+        pthread_mutex_unlock(&b.lock);
+    }
+    for (k = 0; k < nsamples; k++) pthread_join(tids[k], NULL);
+
+    gzwriter_pool_release(threads);
+    jobpool_destroy(pool);
+
+    fprintf(stats, "sample\tmode\trecords\tkept\tdiscarded\tsingles\tseconds\tstatus\n");
+    for (i = 0; i < nsamples; i++) {
+        batch_sample *s = &samples[i];
+
+        /* a failed sample has no counts, but still a line */
+        if (s->status != EXIT_SUCCESS) {
+            fprintf(stderr, "****Error: Sample '%s' failed.\n\n", s->name);
+            fprintf(stats, "%s\t%s\t.\t.\t.\t.\t%.3f\tfailed\n", s->name, s->paired ? "pe" : "se", (s->stop - s->start) / 1e9);
+            failed = 1;
+            continue;
+        }
+        fprintf(stats, "%s\t%s\t%" PRIu64 "\t%" PRIu64 "\t%" PRIu64 "\t%" PRIu64 "\t%.3f\tok\n", s->name, s->paired ? "pe" : "se",
+            s->total, s->kept, s->discard, s->singles, (s->stop - s->start) / 1e9);
+    }
+    if (stats != stdout && fclose(stats) != 0) {
+        fprintf(stderr, "****Error: Could not write '%s'.\n\n", stats_path);
+        failed = 1;
+    }
+
+    profile_report(profile_path);
+
+    for (i = 0; i < nsamples; i++) {
+        for (k = 0; k < samples[i].argc; k++) free(samples[i].argv[k]);
+        free(samples[i].argv);
+        free(samples[i].name);
+    }
+    free(samples);
+    free(order);
+    free(tids);
+    pthread_mutex_destroy(&b.lock);
+    pthread_cond_destroy(&b.cond);
+
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
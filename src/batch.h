@@ -0,0 +1,42 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stdint.h>
+#include "jobqueue.h"
+
+/* sickle batch: many samples in one process. Every sample is an se or
+   pe run of its own (its reader, writer and output files), but the
+   trimming work of all of them goes to one jobpool, so a worker that has
+   nothing left of one sample takes batches of the next. Up to a fixed
+   number of samples run at the same time, the largest inputs first, so
+   that the pool stays busy until the whole sample sheet is done.
+
+   single_run() and paired_run() are se and pe themselves; given a
+   batch_sample they trim on its pool, leave the summary and the
+   profile to sickle batch and hand back their counts instead. */
+
+typedef struct __batch_ batch;
+
+typedef struct {
+    char *name;
+    int paired;
+    int argc;
+    char **argv;        /* the se or pe command line of the sample */
+    uint64_t size;      /* bytes of input, to start the largest samples first */
+    batch *owner;
+    jobpool *pool;      /* the shared trimming threads */
+    int started;        /* the sample has read its options */
+    int status;
+    uint64_t start;
+    uint64_t stop;
+    uint64_t total;     /* records read */
+    uint64_t kept;
+    uint64_t discard;
+    uint64_t singles;   /* of the kept records, those whose mate was discarded */
+} batch_sample;
+
+int single_run (int argc, char *argv[], batch_sample *job);
+int paired_run (int argc, char *argv[], batch_sample *job);
+void batch_started (batch_sample *s);
+
+#endif /* BATCH_H */
@@ -0,0 +1,284 @@
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <zlib.h>
+#include "sickle.h"
+#include "fq_batch.h"
+
+fq_batch *fq_batch_init (int m) {
+    fq_batch *b = (fq_batch *) calloc (1, sizeof (fq_batch));
+
+    b->m = m;
+    b->rec = (kseq_t *) calloc (m, sizeof (kseq_t));
+    b->cut = (cutsites *) calloc (m, sizeof (cutsites));
+    b->off = (size_t *) calloc (3 * m, sizeof (size_t));
+    b->raw = (size_t *) calloc (2 * m, sizeof (size_t));
+    b->mark = (size_t *) calloc (FQ_BATCH_OUTPUTS * m, sizeof (size_t));
+    b->clip = (adapter_clip *) calloc (m, sizeof (adapter_clip));
+    return b;
+}
+
+void fq_batch_destroy (fq_batch *b) {
+    int i;
+
+    if (!b) return;
+
+    /* the records only point into the arenas */
+    free (b->rec);
+    free (b->cut);
+    free (b->off);
+    free (b->raw);
+    free (b->mark);
+    free (b->clip);
+    free (b->names.s);
+    free (b->seqs.s);
+    free (b->quals.s);
+    for (i = 0; i < FQ_BATCH_OUTPUTS; i++) free (b->out[i].s);
+    free (b);
+}
+
+static void fq_grow (fq_batch *b) {
+    int m = b->m * 2;
+
+    b->rec = (kseq_t *) realloc (b->rec, m * sizeof (kseq_t));
+    b->cut = (cutsites *) realloc (b->cut, m * sizeof (cutsites));
+    b->off = (size_t *) realloc (b->off, 3 * m * sizeof (size_t));
+    b->raw = (size_t *) realloc (b->raw, 2 * m * sizeof (size_t));
+    b->mark = (size_t *) realloc (b->mark, FQ_BATCH_OUTPUTS * m * sizeof (size_t));
+    b->clip = (adapter_clip *) realloc (b->clip, m * sizeof (adapter_clip));
+    memset (b->rec + b->m, 0, (m - b->m) * sizeof (kseq_t));
+    b->m = m;
+}
+
+static void fq_reserve (kstring_t *s, size_t len) {
+    if (len + 1 > s->m) {
+        s->m = len + 1;
+        kroundup32 (s->m);
+        s->s = (char *) realloc (s->s, s->m);
+    }
+}
+
+/* append a NUL-terminated field to an arena */
+static void fq_put (kstring_t *s, const char *p, size_t len) {
+    fq_reserve (s, s->l + len);
+    memcpy (s->s + s->l, p, len);
+    s->s[s->l + len] = 0;
+    s->l += len + 1;
+}
+
+void fq_batch_clear (fq_batch *b) {
+    b->n = 0;
+    b->names.l = b->seqs.l = b->quals.l = 0;
+}
+
+/* Point the records' strings into the arenas, which no longer move. */
+void fq_batch_finish (fq_batch *b) {
+    kseq_t *r;
+    size_t *o;
+    int i;
+
+    for (i = 0; i < b->n; i++) {
+        r = &b->rec[i];
+        o = &b->off[3 * i];
+        r->name.s = b->names.s + o[0];
+        r->comment.s = r->name.s + r->name.l + 1;
+        r->seq.s = b->seqs.s + o[1];
+        r->qual.s = b->quals.s + o[2];
+    }
+}
+
+/* Copy the record just read onto the end of the batch's arenas. */
+void fq_batch_push (fq_batch *b, kseq_t *fqrec) {
+    kseq_t *r;
+    size_t *o;
+
+    if (b->n == b->m) fq_grow (b);
+    r = &b->rec[b->n];
+    o = &b->off[3 * b->n++];
+
+    o[0] = b->names.l;
+    fq_put (&b->names, fqrec->name.s, fqrec->name.l);
+    fq_put (&b->names, fqrec->comment.s, fqrec->comment.l);
+    o[1] = b->seqs.l;
+    fq_put (&b->seqs, fqrec->seq.s, fqrec->seq.l);
+    o[2] = b->quals.l;
+    /* a record without qualities leaves the string unallocated */
+    fq_put (&b->quals, fqrec->qual.s ? fqrec->qual.s : "", fqrec->qual.l);
+
+    r->name.l = fqrec->name.l;
+    r->comment.l = fqrec->comment.l;
+    r->seq.l = fqrec->seq.l;
+    r->qual.l = fqrec->qual.l;
+}
+
+/* Parse one record from buf onto the end of the batch's arenas,
+   following kseq_read() character for character so that a mapped file
+   yields exactly the records the stream parser would. *pos is just
+   past the header's '@' or '>'. Returns the sequence length, -1 at end
+   of input or -2 for a truncated quality string; the record is only
+   kept (b->n counts it) for a length. */
+static int fq_parse_record (fq_batch *b, const char *buf, size_t len, size_t *pos, int *last_char) {
+    kseq_t *r = &b->rec[b->n];
+    size_t *o = &b->off[3 * b->n];
+    kstring_t *seq = &b->seqs, *qual = &b->quals;
+    size_t i = *pos, j;
+    int c;
+
+    /* name up to the first white space, then the rest of the line */
+    if (i >= len) {
+        *pos = len;
+        return -1;
+    }
+    for (j = i; j < len && !isspace ((int) buf[j]); j++);
+    o[0] = b->names.l;
+    fq_put (&b->names, buf + i, j - i);
+    r->name.l = j - i;
+    c = (j < len) ? buf[j++] : 0;
+    r->comment.l = 0;
+    i = j;
+    if (c != '\n') {
+        while (j < len && buf[j] != '\n') j++;
+        r->comment.l = j - i;
+        if (j < len) j++;
+    }
+    fq_put (&b->names, buf + i, r->comment.l);
+
+    /* sequence lines up to the '+' line or the next header */
+    o[1] = seq->l;
+    c = -1;
+    while (j < len) {
+        c = buf[j++];
+        if (c == '>' || c == '+' || c == '@') break;
+        if (isgraph (c)) {
+            fq_reserve (seq, seq->l + 1);
+            seq->s[seq->l++] = (char) c;
+        }
+        c = -1;
+    }
+    r->seq.l = seq->l - o[1];
+    fq_put (seq, "", 0);
+    o[2] = qual->l;
+    r->qual.l = 0;
+    fq_reserve (qual, qual->l + r->seq.l);
+    if (c == '>' || c == '@') *last_char = c;
+    if (c != '+') {
+        fq_put (qual, "", 0);
+        *pos = j;
+        return r->seq.l;
+    }
+
+    while (j < len && buf[j] != '\n') j++;
+    if (j == len) {
+        *pos = j;
+        return -2;
+    }
+    j++;
+
+    /* like kseq_read(), this consumes one character past the quality string */
+    while (j < len) {
+        c = buf[j++];
+        if (r->qual.l >= r->seq.l) break;
+        if (c >= 33 && c <= 127) qual->s[qual->l + r->qual.l++] = (char) c;
+    }
+    qual->l += r->qual.l;
+    fq_put (qual, "", 0);
+    *last_char = 0;
+    *pos = j;
+
+    if (r->seq.l != r->qual.l) return -2;
+    return r->seq.l;
+}
+
+/* Parse the records whose header starts in [beg, end) of the batch's
+   text into rec[]. kseq_read() looks for the next header character
+   ('@' or '>') from wherever the previous record ended, so a record may
+   run on past end; next is set to where the record after the last one
+   parsed starts, and first to where the first one did, so the caller
+   can check that consecutive ranges fit together. Returns 0, or -2 if
+   parsing stopped at a truncated record (as kseq_read() does). */
+int fq_batch_parse (fq_batch *b) {
+    const char *buf = b->text;
+    size_t len = b->textlen;
+    size_t pos = b->beg, m;
+    int last_char = 0;
+    int ret;
+
+    fq_batch_clear (b);
+    b->truncated = 0;
+    b->first = len;
+    for (;;) {
+        if (last_char == 0) {
+            for (m = pos; m < len && buf[m] != '>' && buf[m] != '@'; m++);
+        } else m = pos - 1;
+
+        if (b->n == 0) b->first = m;
+        if (m >= b->end) {
+            b->next = m;
+            break;
+        }
+
+        if (b->n == b->m) fq_grow (b);
+        pos = m + 1;
+        ret = fq_parse_record (b, buf, len, &pos, &last_char);
+        if (ret < 0) {
+            b->truncated = (ret == -2);
+            b->next = len;
+            break;
+        }
+        b->raw[2 * b->n] = m;
+        b->raw[2 * b->n + 1] = pos;
+        b->n++;
+    }
+
+    fq_batch_finish (b);
+    return b->truncated ? -2 : 0;
+}
+
+/* length of the line at buf + pos, without its newline */
+static size_t fq_line (const char *buf, size_t len, size_t pos) {
+    const char *nl = (const char *) memchr (buf + pos, '\n', len - pos);
+    return nl ? (size_t) (nl - buf) - pos : len - pos;
+}
+
+/* Find the first record start at or after from: a line beginning with
+   '@', followed by a sequence line, a '+' line and a quality line as
+   long as the sequence, then either the end of the input or another
+   '@'. A quality line can itself begin with '@', but it is never
+   followed by a sequence/'+' pair of matching lengths in this way.
+   Returns len if there is no further record. */
+size_t fq_record_start (const char *buf, size_t len, size_t from) {
+    size_t p = from, l0, l1, l2, l3, q;
+    const char *nl;
+
+    if (p == 0) return 0;
+
+    for (;;) {
+        /* step to the beginning of the next line */
+        if (buf[p - 1] != '\n') {
+            nl = (const char *) memchr (buf + p, '\n', len - p);
+            if (!nl) return len;
+            p = nl - buf + 1;
+        }
+        if (p >= len) return len;
+
+        if (buf[p] == '@') {
+            l0 = fq_line (buf, len, p);
+            q = p + l0 + 1;
+            if (q < len) {
+                l1 = fq_line (buf, len, q);
+                q += l1 + 1;
+                if (q < len && buf[q] == '+') {
+                    l2 = fq_line (buf, len, q);
+                    q += l2 + 1;
+                    if (q < len) {
+                        l3 = fq_line (buf, len, q);
+                        q += l3 + 1;
+                        if (l3 == l1 && (q >= len || buf[q] == '@')) return p;
+                    }
+                }
+            }
+        }
+
+        if (++p >= len) return len;
+    }
+}
@@ -0,0 +1,56 @@
+#ifndef FQ_BATCH_H
+#define FQ_BATCH_H
+
+#include "sickle.h"
+#include "adapter.h"
+
+/* output buffers per batch: paired-end output goes to up to three files */
+#define FQ_BATCH_OUTPUTS 3
+
+/* A batch of FastQ records handed between the reader, the trimming
+   workers and the writer. For paired-end input, mates are stored next
+   to each other: rec[2*i] is the forward read and rec[2*i+1] its mate.
+
+   The fields of all records are stored one after another in three
+   arenas (names with comments, sequences and qualities), each field
+   NUL-terminated, so that a batch is a few large allocations that are
+   reused from one batch to the next. rec[] only holds views into them,
+   set up by fq_batch_finish() once the batch is complete.
+   The worker formats the records it keeps into out[], one buffer per
+   output file, and the writer only has to copy the buffers out.
+
+   A batch can instead carry a byte range [beg, end) of a memory-mapped
+   input file (text, textlen). The worker then parses the records itself
+   with fq_batch_parse(), which also notes where each record lies in the
+   text so that reads kept whole can be copied out as they are. */
+typedef struct __fq_batch_ {
+    kseq_t *rec;        /* only the name/comment/seq/qual strings are used */
+    cutsites *cut;
+    int n, m;
+    kstring_t names;    /* name and comment of each record */
+    kstring_t seqs;
+    kstring_t quals;
+    size_t *off;        /* record i: name at names.s + off[3*i], sequence at
+                           seqs.s + off[3*i+1], qualities at quals.s + off[3*i+2] */
+    const char *text;   /* mapped input file, or NULL */
+    size_t textlen;
+    size_t beg, end;    /* range of text to parse */
+    size_t first, next; /* header of the first record parsed and of the one after the last */
+    size_t *raw;        /* record i is text[raw[2*i], raw[2*i+1]) */
+    int truncated;      /* parsing stopped at a truncated record */
+    kstring_t out[FQ_BATCH_OUTPUTS];
+    adapter_clip *clip; /* adapter trimming: where each record's adapter starts */
+    size_t *mark;       /* sharded output: where each record (pe: pair) ends in the
+                           outputs in use, see outshard_write() */
+    int kept, discard;
+} fq_batch;
+
+fq_batch *fq_batch_init (int m);
+void fq_batch_destroy (fq_batch *b);
+void fq_batch_clear (fq_batch *b);
+void fq_batch_push (fq_batch *b, kseq_t *fqrec);
+void fq_batch_finish (fq_batch *b);
+int fq_batch_parse (fq_batch *b);
+size_t fq_record_start (const char *buf, size_t len, size_t from);
+
+#endif /* FQ_BATCH_H */
@@ -0,0 +1,324 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <inttypes.h>
+#include <getopt.h>
+#include <zlib.h>
+#include <sys/stat.h>
+#include "sickle.h"
+#include "kseq.h"
+#include "fqindex.h"
+
+__KS_GETC(infile_read, BUFFER_SIZE)
+__KS_GETUNTIL(infile_read, BUFFER_SIZE)
+__KSEQ_READ
+
+#define FQINDEX_MAGIC "SICKLEX1"
+
+/* numbers in a point entry of the index file */
+#define FQINDEX_FIELDS 7
+
+static struct option index_long_options[] = {
+    {"span", required_argument, 0, 's'},
+    {"quiet", no_argument, 0, 'z'},
+    {GETOPT_HELP_OPTION_DECL},
+    {GETOPT_VERSION_OPTION_DECL},
+    {NULL, 0, NULL, 0}
+};
+
+void index_usage (int status, char *msg) {
+
+    fprintf(stderr, "\nUsage: %s index [options] <fastq file> [<fastq file> ...]\n\
+\n\
+Writes <fastq file>.sxi, a record index that lets se and pe trim a share of the file with --region K/N.\n\
+\n\
+Options:\n\
+-s, --span, Uncompressed MB between the places a region can start from. Default %d.\n\
+--quiet, Don't print the number of records and access points of each file\n\
+--help, display this help and exit\n\
+--version, output version information and exit\n\n", PROGRAM_NAME, FQINDEX_SPAN_MB);
+
+    if (msg) fprintf(stderr, "%s\n\n", msg);
+    exit(status);
+}
+
+static void fqindex_put (FILE *fp, const uint64_t *v, int n) {
+    unsigned char buf[8 * FQINDEX_FIELDS];
+    int i, j;
+
+    for (i = 0; i < n; i++) {
+        for (j = 0; j < 8; j++) buf[8 * i + j] = (v[i] >> (8 * j)) & 0xff;
+    }
+    fwrite(buf, 1, 8 * n, fp);
+}
+
+static int fqindex_get (FILE *fp, uint64_t *v, int n) {
+    unsigned char buf[8 * FQINDEX_FIELDS];
+    int i, j;
+
+    if (fread(buf, 1, 8 * n, fp) != (size_t) (8 * n)) return 0;
+    for (i = 0; i < n; i++) {
+        v[i] = 0;
+        for (j = 0; j < 8; j++) v[i] |= (uint64_t) buf[8 * i + j] << (8 * j);
+    }
+    return 1;
+}
+
+static char *fqindex_path (const char *input) {
+    char *path = (char *) malloc(strlen(input) + 5);
+
+    sprintf(path, "%s.sxi", input);
+    return path;
+}
+
+/* Index input with an access point every span bytes of output. The
+   record count stops where trimming would, at the end of the file or
+   at a truncated record. */
+static int fqindex_build (const char *input, uint64_t span, int quiet) {
+    infile_point *pt;
+    unsigned char *wbuf;
+    char *path = fqindex_path(input);
+    uint64_t v[FQINDEX_FIELDS], records = 0, npoints = 0, at;
+    uLongf wclen;
+    struct stat st;
+    kseq_t *rec;
+    infile *in;
+    FILE *fp;
+
+    if (IS_STDIO(input) || stat(input, &st) != 0) {
+        fprintf(stderr, "****Error: Could not open input file '%s'.\n\n", input);
+        return EXIT_FAILURE;
+    }
+    in = infile_open(input, 1, 0);
+    if (!in) {
+        fprintf(stderr, "****Error: Could not open input file '%s'.\n\n", input);
+        return EXIT_FAILURE;
+    }
+    fp = fopen(path, "wb");
+    if (!fp) {
+        fprintf(stderr, "****Error: Could not open index file '%s'.\n\n", path);
+        return EXIT_FAILURE;
+    }
+
+    /* the counts are filled in at the end */
+    fwrite(FQINDEX_MAGIC, 1, 8, fp);
+    v[0] = st.st_size;
+    v[1] = 0;
+    v[2] = span;
+    fqindex_put(fp, v, 3);
+
+    pt = (infile_point *) malloc(sizeof(infile_point));
+    wbuf = (unsigned char *) malloc(compressBound(INFILE_WINDOW));
+    infile_checkpoints(in, span);
+    rec = kseq_init(in);
+    while (kseq_read(rec) >= 0) {
+        records++;
+
+        /* where a parser started afresh would find the next record: past
+           what kseq has read, less what it still holds (and the '@' of
+           the next header, if it has read that too) */
+        at = infile_tell(in) - (rec->f->end - rec->f->begin) - (rec->last_char ? 1 : 0);
+
+        while (infile_checkpoint(in, at, pt)) {
+            wclen = compressBound(INFILE_WINDOW);
+            if (compress2(wbuf, &wclen, pt->window, pt->wlen, Z_BEST_SPEED) != Z_OK) {
+                fprintf(stderr, "****Error: Could not compress index window.\n\n");
+                exit(EXIT_FAILURE);
+            }
+            v[0] = pt->in;
+            v[1] = pt->bits;
+            v[2] = pt->out;
+            v[3] = records;
+            v[4] = at - pt->out;
+            v[5] = pt->wlen;
+            v[6] = wclen;
+            fqindex_put(fp, v, FQINDEX_FIELDS);
+            fwrite(wbuf, 1, wclen, fp);
+            npoints++;
+        }
+    }
+    kseq_destroy(rec);
+
+    /* an input that could not be read to its end gets no index */
+    if (infile_error(in)) {
+        infile_close(in);
+        fclose(fp);
+        remove(path);
+        free(pt);
+        free(wbuf);
+        free(path);
+        return EXIT_FAILURE;
+    }
+    infile_close(in);
+
+    fseek(fp, 16, SEEK_SET);
+    fqindex_put(fp, &records, 1);
+    if (fclose(fp) != 0) {
+        fprintf(stderr, "****Error: Could not write index file '%s'.\n\n", path);
+        return EXIT_FAILURE;
+    }
+
+    if (!quiet) fprintf(stdout, "%s: %" PRIu64 " records, %" PRIu64 " access points\n", input, records, npoints);
+    free(pt);
+    free(wbuf);
+    free(path);
+    return EXIT_SUCCESS;
+}
+
+/* Read the index of input; returns NULL, after reporting why, if there
+   is none or it is out of date. */
+fqindex *fqindex_load (const char *input) {
+    fqindex *x = (fqindex *) calloc(1, sizeof(fqindex));
+    uint64_t v[FQINDEX_FIELDS];
+    char magic[8];
+    struct stat st;
+    fqindex_point *p;
+    FILE *fp;
+    int m = 0;
+
+    x->path = fqindex_path(input);
+    fp = fopen(x->path, "rb");
+    if (!fp || fread(magic, 1, 8, fp) != 8 || memcmp(magic, FQINDEX_MAGIC, 8) != 0 || !fqindex_get(fp, v, 3)) {
+        fprintf(stderr, "****Error: Could not read index file '%s' (run %s index on '%s' first).\n\n", x->path, PROGRAM_NAME, input);
+        if (fp) fclose(fp);
+        fqindex_destroy(x);
+        return NULL;
+    }
+    x->size = v[0];
+    x->records = v[1];
+
+    if (stat(input, &st) != 0 || (uint64_t) st.st_size != x->size) {
+        fprintf(stderr, "****Error: Index file '%s' does not match input file '%s' (run %s index again).\n\n", x->path, input, PROGRAM_NAME);
+        fclose(fp);
+        fqindex_destroy(x);
+        return NULL;
+    }
+
+    while (fqindex_get(fp, v, FQINDEX_FIELDS)) {
+        if (x->n == m) {
+            m = m ? 2 * m : 64;
+            x->p = (fqindex_point *) realloc(x->p, m * sizeof(fqindex_point));
+        }
+        p = &x->p[x->n++];
+        p->in = v[0];
+        p->bits = v[1];
+        p->out = v[2];
+        p->record = v[3];
+        p->skip = v[4];
+        p->wlen = v[5];
+        p->wclen = v[6];
+        p->wpos = ftell(fp);
+        if (fseek(fp, p->wclen, SEEK_CUR) != 0) break;
+    }
+    fclose(fp);
+    return x;
+}
+
+/* Open input at the last access point before record, and set *skip to
+   the records between it and record. Returns NULL if the index or the
+   input cannot be read. */
+infile *fqindex_open (const fqindex *x, const char *input, uint64_t record, size_t bufsize, uint64_t *skip) {
+    const fqindex_point *p = NULL;
+    infile_point *pt;
+    infile *in;
+    unsigned char *wbuf;
+    uLongf wlen;
+    FILE *fp;
+    int lo = 0, hi = x->n, mid;
+
+    /* the points are in record order */
+    while (lo < hi) {
+        mid = (lo + hi) / 2;
+        if (x->p[mid].record <= record) lo = mid + 1;
+        else hi = mid;
+    }
+    if (lo > 0) p = &x->p[lo - 1];
+
+    if (!p) {
+        *skip = record;
+        return infile_open_at(input, NULL, 0, bufsize);
+    }
+
+    pt = (infile_point *) malloc(sizeof(infile_point));
+    pt->in = p->in;
+    pt->bits = p->bits;
+    pt->out = p->out;
+    pt->wlen = p->wlen;
+    if (p->wlen) {
+        wbuf = (unsigned char *) malloc(p->wclen);
+        wlen = INFILE_WINDOW;
+        fp = fopen(x->path, "rb");
+        if (!fp || fseek(fp, p->wpos, SEEK_SET) != 0 || fread(wbuf, 1, p->wclen, fp) != p->wclen
+            || uncompress(pt->window, &wlen, wbuf, p->wclen) != Z_OK || wlen != (uLongf) p->wlen) {
+            fprintf(stderr, "****Error: Could not read index file '%s'.\n\n", x->path);
+            if (fp) fclose(fp);
+            free(wbuf);
+            free(pt);
+            return NULL;
+        }
+        fclose(fp);
+        free(wbuf);
+    }
+
+    *skip = record - p->record;
+    in = infile_open_at(input, pt, p->skip, bufsize);
+    free(pt);
+    return in;
+}
+
+void fqindex_destroy (fqindex *x) {
+    if (!x) return;
+    free(x->p);
+    free(x->path);
+    free(x);
+}
+
+int index_main (int argc, char *argv[]) {
+    int optc;
+    extern char *optarg;
+    int span = FQINDEX_SPAN_MB;
+    int quiet = 0;
+    int i;
+
+    while (1) {
+        int option_index = 0;
+        optc = getopt_long(argc, argv, "s:z", index_long_options, &option_index);
+
+        if (optc == -1)
+            break;
+
+        switch (optc) {
+        case 's':
+            span = atoi(optarg);
+            if (span < 1) {
+                fprintf(stderr, "Span must be >= 1\n");
+                return EXIT_FAILURE;
+            }
+            break;
+
+        case 'z':
+            quiet = 1;
+            break;
+
+        case_GETOPT_HELP_CHAR(index_usage)
+        case_GETOPT_VERSION_CHAR(PROGRAM_NAME, VERSION, AUTHORS);
+
+        case '?':
+            index_usage(EXIT_FAILURE, NULL);
+            break;
+
+        default:
+            index_usage(EXIT_FAILURE, NULL);
+            break;
+        }
+    }
+
+    /* argv[optind] is "index"; the files follow it */
+    if (optind + 1 >= argc) index_usage(EXIT_FAILURE, "****Error: Must have at least one input file.");
+
+    for (i = optind + 1; i < argc; i++) {
+        if (fqindex_build(argv[i], (uint64_t) span * 1024 * 1024, quiet) != EXIT_SUCCESS) return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
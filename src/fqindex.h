@@ -0,0 +1,47 @@
+#ifndef FQINDEX_H
+#define FQINDEX_H
+
+#include <stdint.h>
+#include "infile.h"
+
+/* Record index of a FASTQ file, for trimming a share of a large input
+   on each of several nodes (--region K/N). sickle index reads the file
+   once and writes <file>.sxi next to it, which lists an access point of
+   the input (see infile.h) every span bytes of output. Each point also
+   holds the number of the first record that starts after it, and how
+   many bytes after the point that record starts, as kseq counts them.
+   A region starts at the last point before its first record, drops the
+   bytes and records in between, and trims up to the next region's
+   first record.
+
+   .sxi layout, all numbers little-endian 64-bit: the magic "SICKLEX1",
+   the size of the indexed file, its number of records and the span;
+   then per point its in, bits, out, record, skip, window length and
+   deflated window length, followed by the deflated window. */
+
+#define FQINDEX_SPAN_MB 32
+
+typedef struct {
+    uint64_t in;
+    int bits;
+    uint64_t out;
+    uint64_t record;    /* the first record that starts after out */
+    uint64_t skip;      /* bytes from out to where it starts */
+    int wlen;
+    long wpos;          /* where the deflated window is in the index file */
+    uint64_t wclen;
+} fqindex_point;
+
+typedef struct {
+    char *path;         /* of the index file */
+    uint64_t size;      /* of the indexed file, to tell a stale index */
+    uint64_t records;
+    int n;
+    fqindex_point *p;
+} fqindex;
+
+fqindex *fqindex_load (const char *input);
+infile *fqindex_open (const fqindex *x, const char *input, uint64_t record, size_t bufsize, uint64_t *skip);
+void fqindex_destroy (fqindex *x);
+
+#endif /* FQINDEX_H */
@@ -0,0 +1,474 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <zlib.h>
+#include <pthread.h>
+#include "gzwriter.h"
+#include "jobqueue.h"
+#include "profile.h"
+
+/* the memory of a block: 1 MB of input and what it deflates to */
+typedef struct __gzw_buffer_ {
+    char *in;
+    unsigned char *out;
+    size_t outcap;
+    struct __gzw_buffer_ *next;                 /* in the free list */
+} gzw_buffer;
+
+typedef struct {
+    gzw_buffer *buf;                            /* lent by the shared budget, or NULL */
+    char *in;
+    size_t inlen;
+    unsigned char *out;
+    size_t outlen;
+    size_t outcap;
+    int nbgzf;                                  /* BGZF blocks in out */
+    size_t bgzf_size[BGZF_BLOCKS_PER_JOB];      /* compressed size of each */
+} gzw_block;
+
+/* one entry of a .gzi index: where a BGZF block starts */
+typedef struct {
+    unsigned long long coffset;
+    unsigned long long uoffset;
+} gzw_index_entry;
+
+/* the empty block that terminates every BGZF file */
+static const unsigned char bgzf_eof[28] = {
+    0x1f, 0x8b, 0x08, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0xff, 0x06, 0x00, 0x42, 0x43,
+    0x02, 0x00, 0x1b, 0x00, 0x03, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+};
+
+struct __gzwriter_ {
+    FILE *fp;
+    char *path;
+    char *index_path;
+    int format;
+    int nthreads;           /* of the shared pool, or 0 */
+    z_stream *zs;           /* one deflate stream per compressing thread */
+    int *zs_ready;
+    gzw_block *blocks;
+    void **jobs;
+    int nslots;
+    gzw_block *cur;         /* block being filled */
+    long nblocks;
+    unsigned long long coffset;     /* compressed bytes written so far */
+    unsigned long long uoffset;     /* uncompressed bytes written so far */
+    gzw_index_entry *index;
+    size_t nindex, mindex;
+    jobqueue *q;            /* NULL when compressing on the calling thread */
+    pthread_t writer;
+    volatile int error;     /* compressing or writing failed; nothing more is written */
+};
+
+/* The compression threads of the process. All the gzip outputs of a run
+   (the three of pe, every shard) queue their blocks on the same pool, so
+   -T N compresses on N threads in all rather than on N per output. The
+   first writer that needs threads starts the pool with its nthreads, and
+   the last one to close stops it; sickle batch holds it open for all of
+   its samples.
+
+   The memory of their blocks comes from one budget as well: two blocks
+   for every thread, so that each has one to compress while the next
+   waits, and one more for every writer to fill. However many outputs
+   and shards there are, the blocks in flight only grow with the
+   threads. */
+static jobpool *gzw_pool = NULL;
+static int gzw_pool_users = 0;
+static gzw_buffer *gzw_free = NULL;
+static int gzw_nbuffers = 0;
+static pthread_mutex_t gzw_pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t gzw_pool_cond = PTHREAD_COND_INITIALIZER;
+
+static jobpool *gzw_pool_attach (int nthreads) {
+    jobpool *p;
+
+    pthread_mutex_lock (&gzw_pool_lock);
+    if (!gzw_pool) gzw_pool = jobpool_init (nthreads);
+    gzw_pool_users++;
+    p = gzw_pool;
+    pthread_cond_broadcast (&gzw_pool_cond);
+    pthread_mutex_unlock (&gzw_pool_lock);
+    return p;
+}
+
+static void gzw_pool_detach (void) {
+    gzw_buffer *f;
+
+    pthread_mutex_lock (&gzw_pool_lock);
+    if (--gzw_pool_users == 0) {
+        jobpool_destroy (gzw_pool);
+        gzw_pool = NULL;
+        while ((f = gzw_free)) {
+            gzw_free = f->next;
+            free (f->in);
+            free (f->out);
+            free (f);
+        }
+        gzw_nbuffers = 0;
+    }
+    pthread_mutex_unlock (&gzw_pool_lock);
+}
+
+/* Keep the compression threads up between the outputs of the samples
+   of a batch, which then all compress on the same nthreads. */
+void gzwriter_pool_hold (int nthreads) {
+    if (nthreads > 1) gzw_pool_attach (nthreads);
+}
+
+void gzwriter_pool_release (int nthreads) {
+    if (nthreads > 1) gzw_pool_detach ();
+}
+
+/* lend b the memory of a block, waiting for one if the budget is spent */
+static void gzw_borrow (gzw_block *b) {
+    gzw_buffer *f;
+
+    pthread_mutex_lock (&gzw_pool_lock);
+    while (!gzw_free && gzw_nbuffers >= 2 * gzw_pool->nworkers + gzw_pool_users) {
+        pthread_cond_wait (&gzw_pool_cond, &gzw_pool_lock);
+    }
+    if ((f = gzw_free)) gzw_free = f->next;
+    else {
+        f = (gzw_buffer *) calloc (1, sizeof (gzw_buffer));
+        f->in = (char *) malloc (GZW_BLOCK_SIZE);
+        gzw_nbuffers++;
+    }
+    pthread_mutex_unlock (&gzw_pool_lock);
+
+    b->buf = f;
+    b->in = f->in;
+    b->out = f->out;
+    b->outcap = f->outcap;
+}
+
+/* give the memory of b back to the budget */
+static void gzw_return (gzw_block *b) {
+    gzw_buffer *f = b->buf;
+
+    f->out = b->out;
+    f->outcap = b->outcap;
+    b->buf = NULL;
+    b->in = NULL;
+    b->out = NULL;
+    b->outcap = 0;
+
+    pthread_mutex_lock (&gzw_pool_lock);
+    f->next = gzw_free;
+    gzw_free = f;
+    pthread_cond_signal (&gzw_pool_cond);
+    pthread_mutex_unlock (&gzw_pool_lock);
+}
+
+/* Report an error; the output stops there and gzwriter_close() fails. */
+static void gzw_fail (gzwriter *gz, const char *what) {
+    if (!gz->error) fprintf (stderr, "****Error: Could not %s output file '%s'.\n\n", what, gz->path);
+    gz->error = 1;
+}
+
+static void put_le16 (unsigned char *p, unsigned int v) {
+    p[0] = v & 0xff;
+    p[1] = (v >> 8) & 0xff;
+}
+
+static void put_le32 (unsigned char *p, unsigned long v) {
+    put_le16 (p, v & 0xffff);
+    put_le16 (p + 2, (v >> 16) & 0xffff);
+}
+
+/* deflate up to BGZF_BLOCK_SIZE bytes into one BGZF block at out, returns its size */
+static size_t bgzf_compress (gzwriter *gz, z_stream *z, const char *in, size_t inlen, unsigned char *out) {
+    static const unsigned char header[16] = {
+        0x1f, 0x8b, 0x08, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0xff, 0x06, 0x00, 0x42, 0x43, 0x02, 0x00
+    };
+    size_t size;
+    int ret;
+
+    deflateReset (z);
+    z->next_in = (unsigned char *) in;
+    z->avail_in = inlen;
+    z->next_out = out + 18;
+    z->avail_out = BGZF_MAX_BLOCK_SIZE - 18 - 8;
+    ret = deflate (z, Z_FINISH);
+
+    /* data that does not shrink may not fit; store it uncompressed instead */
+    if (ret != Z_STREAM_END) {
+        deflateReset (z);
+        deflateParams (z, Z_NO_COMPRESSION, Z_DEFAULT_STRATEGY);
+        z->next_in = (unsigned char *) in;
+        z->avail_in = inlen;
+        z->next_out = out + 18;
+        z->avail_out = BGZF_MAX_BLOCK_SIZE - 18 - 8;
+        ret = deflate (z, Z_FINISH);
+        deflateReset (z);
+        deflateParams (z, Z_DEFAULT_COMPRESSION, Z_DEFAULT_STRATEGY);
+    }
+    if (ret != Z_STREAM_END) gzw_fail (gz, "compress");
+
+    size = 18 + (BGZF_MAX_BLOCK_SIZE - 18 - 8 - z->avail_out) + 8;
+    memcpy (out, header, 16);
+    put_le16 (out + 16, size - 1);
+    put_le32 (out + size - 8, crc32 (crc32 (0L, Z_NULL, 0), (unsigned char *) in, inlen));
+    put_le32 (out + size - 4, inlen);
+
+    return size;
+}
+
+/* deflate one block into a complete gzip member, or a run of BGZF blocks */
+static void gzw_compress (void *arg, void *job, int tid) {
+    gzwriter *gz = (gzwriter *) arg;
+    gzw_block *b = (gzw_block *) job;
+    z_stream *z = &gz->zs[tid];
+    size_t bound, off, n;
+    uint64_t t0 = PROFILE_START ();
+
+    if (!gz->zs_ready[tid]) {
+        /* BGZF writes its own header, so it needs a raw deflate stream */
+        if (deflateInit2 (z, Z_DEFAULT_COMPRESSION, Z_DEFLATED, (gz->format == GZW_BGZF) ? -15 : 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            gzw_fail (gz, "compress");
+            b->outlen = 0;
+            return;
+        }
+        gz->zs_ready[tid] = 1;
+    } else {
+        deflateReset (z);
+    }
+
+    if (gz->format == GZW_BGZF) {
+        bound = BGZF_BLOCKS_PER_JOB * BGZF_MAX_BLOCK_SIZE;
+    } else {
+        bound = deflateBound (z, b->inlen);
+    }
+    if (b->outcap < bound) {
+        b->outcap = bound;
+        b->out = (unsigned char *) realloc (b->out, b->outcap);
+    }
+
+    if (gz->format == GZW_BGZF) {
+        b->outlen = 0;
+        b->nbgzf = 0;
+        for (off = 0; off < b->inlen; off += n) {
+            n = b->inlen - off;
+            if (n > BGZF_BLOCK_SIZE) n = BGZF_BLOCK_SIZE;
+            b->bgzf_size[b->nbgzf] = bgzf_compress (gz, z, b->in + off, n, b->out + b->outlen);
+            b->outlen += b->bgzf_size[b->nbgzf++];
+        }
+        PROFILE_STOP (PROF_COMPRESS, t0, 0, b->inlen);
+        return;
+    }
+
+    z->next_in = (unsigned char *) b->in;
+    z->avail_in = b->inlen;
+    z->next_out = b->out;
+    z->avail_out = b->outcap;
+    if (deflate (z, Z_FINISH) != Z_STREAM_END) gzw_fail (gz, "compress");
+
+    b->outlen = b->outcap - z->avail_out;
+    PROFILE_STOP (PROF_COMPRESS, t0, 0, b->inlen);
+}
+
+static void gzw_emit (gzwriter *gz, gzw_block *b) {
+    int i;
+
+    if (!gz->error && fwrite (b->out, 1, b->outlen, gz->fp) != b->outlen) gzw_fail (gz, "write");
+
+    if (gz->format == GZW_BGZF) {
+        /* remember where each BGZF block starts; the first one is implicit in a .gzi */
+        for (i = 0; i < b->nbgzf; i++) {
+            if (gz->coffset > 0) {
+                if (gz->nindex == gz->mindex) {
+                    gz->mindex = gz->mindex ? 2 * gz->mindex : 256;
+                    gz->index = (gzw_index_entry *) realloc (gz->index, gz->mindex * sizeof (gzw_index_entry));
+                }
+                gz->index[gz->nindex].coffset = gz->coffset;
+                gz->index[gz->nindex].uoffset = gz->uoffset;
+                gz->nindex++;
+            }
+            gz->coffset += b->bgzf_size[i];
+            gz->uoffset += (i < b->nbgzf - 1) ? BGZF_BLOCK_SIZE : b->inlen - (size_t) i * BGZF_BLOCK_SIZE;
+        }
+    }
+
+    b->inlen = 0;
+    if (b->buf) gzw_return (b);
+}
+
+/* .gzi layout (as written by bgzip -i): entry count, then pairs of
+   compressed and uncompressed offsets, all little-endian 64-bit */
+static void gzw_write_index (gzwriter *gz) {
+    unsigned char buf[16];
+    FILE *fp;
+    size_t i;
+    int j;
+
+    fp = fopen (gz->index_path, "wb");
+    if (!fp) {
+        fprintf (stderr, "****Error: Could not open index file '%s'.\n\n", gz->index_path);
+        gz->error = 1;
+        return;
+    }
+
+    for (j = 0; j < 8; j++) buf[j] = ((unsigned long long) gz->nindex >> (8 * j)) & 0xff;
+    fwrite (buf, 1, 8, fp);
+
+    for (i = 0; i < gz->nindex; i++) {
+        for (j = 0; j < 8; j++) {
+            buf[j] = (gz->index[i].coffset >> (8 * j)) & 0xff;
+            buf[8 + j] = (gz->index[i].uoffset >> (8 * j)) & 0xff;
+        }
+        fwrite (buf, 1, 16, fp);
+    }
+
+    if (fclose (fp) != 0) {
+        fprintf (stderr, "****Error: Could not write index file '%s'.\n\n", gz->index_path);
+        gz->error = 1;
+    }
+}
+
+static void *gzw_writer (void *data) {
+    gzwriter *gz = (gzwriter *) data;
+    gzw_block *b;
+
+    while ((b = (gzw_block *) jobqueue_next (gz->q))) {
+        gzw_emit (gz, b);
+        jobqueue_release (gz->q);
+    }
+
+    return NULL;
+}
+
+gzwriter *gzwriter_open (const char *path, int nthreads, int format, int index) {
+    jobpool *pool = NULL;
+    gzwriter *gz;
+    FILE *fp;
+    int i;
+
+    /* "-" is standard output, which cannot have an index next to it */
+    if (!strcmp (path, "-")) {
+        if (index) return NULL;
+        fp = stdout;
+    } else {
+        fp = fopen (path, "wb");
+    }
+    if (!fp) return NULL;
+
+    gz = (gzwriter *) calloc (1, sizeof (gzwriter));
+    gz->fp = fp;
+    gz->path = strdup (path);
+    gz->format = format;
+    if (index && format == GZW_BGZF) {
+        gz->index_path = (char *) malloc (strlen (path) + 5);
+        sprintf (gz->index_path, "%s.gzi", path);
+    }
+    if (nthreads > 1) {
+        pool = gzw_pool_attach (nthreads);
+        gz->nthreads = pool->nworkers;
+    }
+    gz->zs = (z_stream *) calloc (gz->nthreads + 1, sizeof (z_stream));
+    gz->zs_ready = (int *) calloc (gz->nthreads + 1, sizeof (int));
+
+    /* enough blocks to keep every compressing thread busy while one is
+       being filled; with threads, a block only has memory (from the
+       shared budget) while it holds data */
+    gz->nslots = gz->nthreads ? 2 * gz->nthreads + 2 : 1;
+    gz->blocks = (gzw_block *) calloc (gz->nslots, sizeof (gzw_block));
+    gz->jobs = (void **) malloc (gz->nslots * sizeof (void *));
+    for (i = 0; i < gz->nslots; i++) gz->jobs[i] = &gz->blocks[i];
+    if (!gz->nthreads) gz->blocks[0].in = (char *) malloc (GZW_BLOCK_SIZE);
+
+    if (gz->nthreads) {
+        gz->q = jobqueue_init_pool (pool, gz->jobs, gz->nslots, gzw_compress, gz);
+        if (pthread_create (&gz->writer, NULL, gzw_writer, gz) != 0) {
+            fprintf (stderr, "****Error: Could not start writer thread.\n\n");
+            exit (EXIT_FAILURE);
+        }
+        gz->cur = (gzw_block *) jobqueue_acquire (gz->q);
+        gzw_borrow (gz->cur);
+    } else {
+        gz->cur = &gz->blocks[0];
+    }
+
+    return gz;
+}
+
+/* hand the current block to the compressors and start a new one */
+static void gzw_flush (gzwriter *gz) {
+    gz->nblocks++;
+
+    if (gz->q) {
+        jobqueue_submit (gz->q);
+        gz->cur = (gzw_block *) jobqueue_acquire (gz->q);
+        gzw_borrow (gz->cur);
+    } else {
+        gzw_compress (gz, gz->cur, 0);
+        gzw_emit (gz, gz->cur);
+    }
+}
+
+void gzwriter_write (gzwriter *gz, const char *buf, size_t len) {
+    size_t n;
+
+    while (len > 0) {
+        n = GZW_BLOCK_SIZE - gz->cur->inlen;
+        if (n > len) n = len;
+
+        memcpy (gz->cur->in + gz->cur->inlen, buf, n);
+        gz->cur->inlen += n;
+        buf += n;
+        len -= n;
+
+        if (gz->cur->inlen == GZW_BLOCK_SIZE) gzw_flush (gz);
+    }
+}
+
+/* Returns -1 if the output could not be written in full (which has been
+   reported), else 0. */
+int gzwriter_close (gzwriter *gz) {
+    int i, ret;
+
+    if (!gz) return 0;
+
+    /* an empty output still gets one (empty) gzip member; BGZF has its EOF block for that */
+    if (gz->cur->inlen > 0 || (gz->nblocks == 0 && gz->format != GZW_BGZF)) {
+        gz->nblocks++;
+        if (gz->q) jobqueue_submit (gz->q);
+        else {
+            gzw_compress (gz, gz->cur, 0);
+            gzw_emit (gz, gz->cur);
+        }
+    } else if (gz->cur->buf) {
+        gzw_return (gz->cur);
+    }
+
+    if (gz->q) {
+        jobqueue_close (gz->q);
+        pthread_join (gz->writer, NULL);
+        jobqueue_destroy (gz->q);
+        gzw_pool_detach ();
+    }
+
+    /* a failed output gets no EOF block or index, which would make it look complete */
+    if (gz->format == GZW_BGZF && !gz->error) {
+        if (fwrite (bgzf_eof, 1, sizeof (bgzf_eof), gz->fp) != sizeof (bgzf_eof)) gzw_fail (gz, "write");
+        if (gz->index_path && !gz->error) gzw_write_index (gz);
+    }
+
+    if (fclose (gz->fp) != 0) gzw_fail (gz, "write");
+
+    for (i = 0; i <= gz->nthreads; i++) {
+        if (gz->zs_ready[i]) deflateEnd (&gz->zs[i]);
+    }
+    for (i = 0; i < gz->nslots; i++) {
+        free (gz->blocks[i].in);
+        free (gz->blocks[i].out);
+    }
+    free (gz->blocks);
+    free (gz->jobs);
+    free (gz->zs);
+    free (gz->zs_ready);
+    free (gz->index);
+    free (gz->index_path);
+    free (gz->path);
+    ret = gz->error ? -1 : 0;
+    free (gz);
+    return ret;
+}
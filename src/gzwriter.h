@@ -0,0 +1,39 @@
+#ifndef GZWRITER_H
+#define GZWRITER_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+/* Block-parallel gzip writer. Output is cut into fixed-size blocks and
+   every block is deflated as its own gzip member, so blocks can be
+   compressed on a pool of threads and the file is still a valid
+   (multi-member) gzip file for gzip -d, zcat and zlib's gzread. The
+   threads are shared by all the writers open at the same time.
+
+   In BGZF mode every 1 MB block is further cut into BGZF blocks of at
+   most 64 KB, each carrying its compressed size in the BC extra field,
+   and the file ends with the standard empty EOF block. The offsets of
+   the BGZF blocks can be saved next to the file as <path>.gzi (the
+   bgzip -i format) for random access. */
+
+#define GZW_BLOCK_SIZE (1024 * 1024)
+
+/* largest amount of uncompressed data in one BGZF block (as in htslib) */
+#define BGZF_BLOCK_SIZE 0xff00
+#define BGZF_MAX_BLOCK_SIZE 0x10000
+#define BGZF_BLOCKS_PER_JOB ((GZW_BLOCK_SIZE + BGZF_BLOCK_SIZE - 1) / BGZF_BLOCK_SIZE)
+
+typedef enum {
+  GZW_GZIP,
+  GZW_BGZF
+} gzwriter_format;
+
+typedef struct __gzwriter_ gzwriter;
+
+gzwriter *gzwriter_open (const char *path, int nthreads, int format, int index);
+void gzwriter_write (gzwriter *gz, const char *buf, size_t len);
+int gzwriter_close (gzwriter *gz);
+void gzwriter_pool_hold (int nthreads);
+void gzwriter_pool_release (int nthreads);
+
+#endif /* GZWRITER_H */
@@ -0,0 +1,666 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <zlib.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "infile.h"
+#include "jobqueue.h"
+#include "profile.h"
+
+#define INF_BUF_SIZE (1024 * 1024)      /* raw bytes read from the file at a time */
+#define INF_JOB_SIZE (1024 * 1024)      /* compressed bytes gathered into one job */
+#define INF_JOB_BLOCKS 256              /* at most this many members per job */
+#define INF_READ_AHEAD 4                /* decompressed buffers kept ahead of the parser */
+
+enum {
+  INF_PLAIN,
+  INF_GZIP,
+  INF_BGZF
+};
+
+typedef struct {
+    unsigned char *in;
+    size_t inlen, incap;
+    int nblk;
+    size_t blk_off[INF_JOB_BLOCKS];     /* member start in in */
+    size_t blk_len[INF_JOB_BLOCKS];     /* member length, header to trailer */
+    size_t blk_hdr[INF_JOB_BLOCKS];     /* member header length */
+    size_t blk_uoff[INF_JOB_BLOCKS];    /* where the member's data goes in out */
+    unsigned char *out;
+    size_t outlen, outcap;
+    size_t pos;                         /* next byte handed to the reader */
+    int inflated;                       /* out was filled by the serial inflater */
+} inf_job;
+
+struct __infile_ {
+    FILE *fp;
+    char *path;
+    int mode;
+    unsigned char *buf;                 /* raw bytes from the file */
+    size_t beg, end;
+    int eof;
+    z_stream z;                         /* serial inflater */
+    int z_ready;
+    int z_done;
+    int raw;                            /* z was started inside a member by infile_open_at() */
+    uint64_t foff;                      /* file offset of buf */
+    uint64_t out;                       /* bytes handed to the caller */
+    uint64_t span;                      /* output between access points, or 0 to record none */
+    uint64_t zout;                      /* output of the serial inflater */
+    uint64_t last;                      /* where the last access point was recorded */
+    unsigned char *window;              /* the last INFILE_WINDOW bytes of output, circular */
+    size_t wpos;
+    infile_point *points;               /* recorded access points not taken yet */
+    int npoints, mpoints;
+    int nthreads;
+    size_t chunk;                       /* size of a read-ahead buffer */
+    z_stream *zs;                       /* one raw inflater per worker */
+    int *zs_ready;
+    inf_job *jobs;
+    void **jobp;
+    int nslots;
+    jobqueue *q;
+    pthread_t reader;
+    inf_job *cur;
+    volatile int stop;
+    volatile int error;                 /* reading failed, and it was reported */
+};
+
+/* Report a read error. The input then ends there, as if at the end of
+   the file, and infile_error() tells the caller. */
+static void inf_fail (infile *in, const char *what) {
+    if (!in->error) fprintf (stderr, "****Error: Could not %s input file '%s'.\n\n", what, in->path);
+    in->error = 1;
+}
+
+static void inf_truncated (infile *in) {
+    if (!in->error) fprintf (stderr, "****Error: Input file '%s' is truncated.\n\n", in->path);
+    in->error = 1;
+}
+
+/* make at least need raw bytes available at buf + beg; returns 0 at end of file */
+static int inf_fill (infile *in, size_t need) {
+    size_t n;
+
+    while (in->end - in->beg < need && !in->eof) {
+        if (in->beg > 0) {
+            memmove (in->buf, in->buf + in->beg, in->end - in->beg);
+            in->end -= in->beg;
+            in->foff += in->beg;
+            in->beg = 0;
+        }
+
+        n = fread (in->buf + in->end, 1, INF_BUF_SIZE - in->end, in->fp);
+        if (n == 0) {
+            if (ferror (in->fp)) inf_fail (in, "read");
+            in->eof = 1;
+        }
+        in->end += n;
+    }
+
+    return in->end - in->beg >= need;
+}
+
+/* If a BGZF member starts at buf + beg, return its total size and set
+   *hdr to its header length. Returns 0 for any other gzip member. */
+static size_t bgzf_member_size (infile *in, size_t *hdr) {
+    unsigned char *h;
+    size_t xlen, i, slen;
+
+    if (!inf_fill (in, 12)) return 0;
+    h = in->buf + in->beg;
+
+    /* gzip, deflate, and FEXTRA as the only flag */
+    if (h[0] != 0x1f || h[1] != 0x8b || h[2] != 8 || h[3] != 4) return 0;
+
+    xlen = h[10] | (h[11] << 8);
+    if (!inf_fill (in, 12 + xlen)) return 0;
+    h = in->buf + in->beg;
+
+    for (i = 12; i + 4 <= 12 + xlen; i += 4 + slen) {
+        slen = h[i+2] | (h[i+3] << 8);
+        if (h[i] == 'B' && h[i+1] == 'C' && slen == 2 && i + 6 <= 12 + xlen) {
+            *hdr = 12 + xlen;
+            return (h[i+4] | (h[i+5] << 8)) + 1;
+        }
+    }
+
+    return 0;
+}
+
+/* Keep the last INFILE_WINDOW bytes of output, and record an access
+   point if the inflater stopped at a block boundary at least span
+   bytes after the last one. */
+static void inf_track (infile *in, const unsigned char *p, size_t n) {
+    z_stream *z = &in->z;
+    infile_point *pt;
+    size_t k;
+
+    in->zout += n;
+    if (n >= INFILE_WINDOW) {
+        p += n - INFILE_WINDOW;
+        n = INFILE_WINDOW;
+    }
+    while (n > 0) {
+        k = INFILE_WINDOW - in->wpos;
+        if (k > n) k = n;
+        memcpy (in->window + in->wpos, p, k);
+        in->wpos = (in->wpos + k) % INFILE_WINDOW;
+        p += k;
+        n -= k;
+    }
+
+    /* at the end of a block that is not the last of its member */
+    if (!(z->data_type & 128) || (z->data_type & 64) || in->zout - in->last < in->span) return;
+
+    if (in->npoints == in->mpoints) {
+        in->mpoints = in->mpoints ? 2 * in->mpoints : 4;
+        in->points = (infile_point *) realloc (in->points, in->mpoints * sizeof (infile_point));
+    }
+    pt = &in->points[in->npoints++];
+    pt->in = in->foff + in->beg;
+    pt->bits = z->data_type & 7;
+    pt->out = in->zout;
+    pt->wlen = (in->zout < INFILE_WINDOW) ? in->zout : INFILE_WINDOW;
+    k = (in->wpos + INFILE_WINDOW - pt->wlen) % INFILE_WINDOW;
+    if (k + pt->wlen <= INFILE_WINDOW) memcpy (pt->window, in->window + k, pt->wlen);
+    else {
+        memcpy (pt->window, in->window + k, INFILE_WINDOW - k);
+        memcpy (pt->window + INFILE_WINDOW - k, in->window, pt->wlen - (INFILE_WINDOW - k));
+    }
+    in->last = in->zout;
+}
+
+/* Inflate up to len bytes of a gzip stream of one or more members.
+   Like gzip, anything after the last member that is not another gzip
+   header is ignored. */
+static size_t inf_inflate (infile *in, unsigned char *out, size_t len) {
+    z_stream *z = &in->z;
+    unsigned char *p;
+    int ret;
+
+    if (!in->z_ready) {
+        if (inflateInit2 (z, 15 + 32) != Z_OK) {
+            inf_fail (in, "decompress");
+            return 0;
+        }
+        in->z_ready = 1;
+    }
+
+    z->next_out = out;
+    z->avail_out = len;
+
+    while (z->avail_out > 0 && !in->z_done) {
+        if (in->beg == in->end && !inf_fill (in, 1)) {
+            inf_truncated (in);
+            in->z_done = 1;
+            break;
+        }
+
+        z->next_in = in->buf + in->beg;
+        z->avail_in = in->end - in->beg;
+        p = z->next_out;
+        ret = inflate (z, in->span ? Z_BLOCK : Z_NO_FLUSH);
+        in->beg = in->end - z->avail_in;
+        if (in->span) inf_track (in, p, z->next_out - p);
+
+        if (ret == Z_STREAM_END) {
+            if (in->raw) {
+                /* the trailer of the member that was started inside, then whole members again */
+                if (!inf_fill (in, 8)) {
+                    inf_truncated (in);
+                    in->z_done = 1;
+                    break;
+                }
+                in->beg += 8;
+                inflateReset2 (z, 15 + 32);
+                in->raw = 0;
+            }
+            else inflateReset (z);
+            if (!inf_fill (in, 2) || in->buf[in->beg] != 0x1f || in->buf[in->beg+1] != 0x8b) {
+                in->z_done = 1;
+            }
+        } else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+            inf_fail (in, "decompress");
+            in->z_done = 1;
+        }
+    }
+
+    return len - z->avail_out;
+}
+
+/* copy up to len bytes of an uncompressed file */
+static size_t inf_read_plain (infile *in, unsigned char *out, size_t len) {
+    size_t got = 0, n;
+
+    /* bytes already read while detecting the format come first */
+    if (in->beg < in->end) {
+        got = in->end - in->beg;
+        if (got > len) got = len;
+        memcpy (out, in->buf + in->beg, got);
+        in->beg += got;
+    }
+
+    while (got < len && !in->eof) {
+        n = fread (out + got, 1, len - got, in->fp);
+        if (n == 0) {
+            if (ferror (in->fp)) inf_fail (in, "read");
+            in->eof = 1;
+        }
+        got += n;
+    }
+
+    return got;
+}
+
+/* worker: inflate every BGZF member of a job into its place in out */
+static void inf_inflate_job (void *arg, void *data, int tid) {
+    infile *in = (infile *) arg;
+    inf_job *job = (inf_job *) data;
+    z_stream *z = &in->zs[tid];
+    unsigned char *m;
+    size_t usize;
+    unsigned long crc;
+    uint64_t t0;
+    int i;
+
+    if (job->inflated) return;
+    t0 = PROFILE_START ();
+
+    if (!in->zs_ready[tid]) {
+        if (inflateInit2 (z, -15) != Z_OK) {
+            inf_fail (in, "decompress");
+            return;
+        }
+        in->zs_ready[tid] = 1;
+    }
+
+    for (i = 0; i < job->nblk; i++) {
+        m = job->in + job->blk_off[i];
+        usize = (i + 1 < job->nblk ? job->blk_uoff[i+1] : job->outlen) - job->blk_uoff[i];
+
+        inflateReset (z);
+        z->next_in = m + job->blk_hdr[i];
+        z->avail_in = job->blk_len[i] - job->blk_hdr[i] - 8;
+        z->next_out = job->out + job->blk_uoff[i];
+        z->avail_out = usize;
+        if (inflate (z, Z_FINISH) != Z_STREAM_END || z->avail_out != 0) {
+            inf_fail (in, "decompress");
+            return;
+        }
+
+        m += job->blk_len[i] - 8;
+        crc = m[0] | (m[1] << 8) | ((unsigned long) m[2] << 16) | ((unsigned long) m[3] << 24);
+        if (crc != crc32 (crc32 (0L, Z_NULL, 0), job->out + job->blk_uoff[i], usize)) {
+            inf_fail (in, "decompress");
+            return;
+        }
+    }
+
+    PROFILE_STOP (PROF_READ, t0, 0, job->outlen);
+}
+
+/* Reader thread. For BGZF it cuts the compressed file into jobs at
+   member boundaries for the workers; otherwise it decompresses (or
+   just reads) the file itself into large buffers ahead of the parser. */
+static void *inf_reader (void *data) {
+    infile *in = (infile *) data;
+    inf_job *job;
+    size_t size, hdr, isize;
+    unsigned char *t;
+    uint64_t t0;
+    int serial = (in->mode != INF_BGZF);
+
+    while (!in->stop && !in->error) {
+        job = (inf_job *) jobqueue_acquire (in->q);
+        if (in->stop) break;
+
+        job->inlen = job->outlen = job->pos = 0;
+        job->nblk = 0;
+        job->inflated = 0;
+
+        if (serial) {
+            /* past the first non-BGZF member everything is inflated here */
+            if (job->outcap < in->chunk) {
+                job->outcap = in->chunk;
+                job->out = (unsigned char *) realloc (job->out, job->outcap);
+            }
+            t0 = PROFILE_START ();
+            if (in->mode == INF_PLAIN) job->outlen = inf_read_plain (in, job->out, in->chunk);
+            else job->outlen = inf_inflate (in, job->out, in->chunk);
+            PROFILE_STOP (PROF_READ, t0, 0, job->outlen);
+            job->inflated = 1;
+            if (job->outlen == 0) break;
+            jobqueue_submit (in->q);
+            continue;
+        }
+
+        while (job->nblk < INF_JOB_BLOCKS && job->inlen < INF_JOB_SIZE) {
+            if (!inf_fill (in, 1)) break;
+
+            size = bgzf_member_size (in, &hdr);
+            if (size == 0) {
+                /* trailing bytes that are not gzip are ignored, as gzip does */
+                if (!inf_fill (in, 2) || in->buf[in->beg] != 0x1f || in->buf[in->beg+1] != 0x8b) {
+                    in->beg = in->end;
+                    in->eof = 1;
+                    break;
+                }
+                serial = 1;
+                break;
+            }
+            if (size < hdr + 8 || !inf_fill (in, size)) {
+                inf_truncated (in);
+                break;
+            }
+
+            if (job->incap < job->inlen + size) {
+                job->incap = 2 * (job->inlen + size);
+                job->in = (unsigned char *) realloc (job->in, job->incap);
+            }
+            memcpy (job->in + job->inlen, in->buf + in->beg, size);
+            in->beg += size;
+
+            t = job->in + job->inlen + size - 4;
+            isize = t[0] | (t[1] << 8) | ((size_t) t[2] << 16) | ((size_t) t[3] << 24);
+
+            job->blk_off[job->nblk] = job->inlen;
+            job->blk_len[job->nblk] = size;
+            job->blk_hdr[job->nblk] = hdr;
+            job->blk_uoff[job->nblk] = job->outlen;
+            job->nblk++;
+            job->inlen += size;
+            job->outlen += isize;
+        }
+
+        if (in->error) break;
+        if (job->nblk == 0) {
+            if (serial) continue;
+            break;
+        }
+
+        if (job->outcap < job->outlen) {
+            job->outcap = job->outlen;
+            job->out = (unsigned char *) realloc (job->out, job->outcap);
+        }
+        jobqueue_submit (in->q);
+    }
+
+    jobqueue_close (in->q);
+    return NULL;
+}
+
+/* start the reader thread (and the inflate workers for BGZF) */
+static void inf_start (infile *in, int nthreads, size_t bufsize) {
+    int i;
+
+    in->chunk = bufsize ? bufsize : INF_JOB_SIZE;
+
+    if (in->mode == INF_BGZF || bufsize > 0) {
+        in->nthreads = (in->mode == INF_BGZF) ? nthreads : 0;
+        in->zs = (z_stream *) calloc (in->nthreads + 1, sizeof (z_stream));
+        in->zs_ready = (int *) calloc (in->nthreads + 1, sizeof (int));
+        in->nslots = in->nthreads ? 2 * in->nthreads + 2 : INF_READ_AHEAD;
+        in->jobs = (inf_job *) calloc (in->nslots, sizeof (inf_job));
+        in->jobp = (void **) malloc (in->nslots * sizeof (void *));
+        for (i = 0; i < in->nslots; i++) in->jobp[i] = &in->jobs[i];
+
+        in->q = jobqueue_init (in->jobp, in->nslots, in->nthreads, inf_inflate_job, in);
+        if (pthread_create (&in->reader, NULL, inf_reader, in) != 0) {
+            fprintf (stderr, "****Error: Could not start reader thread.\n\n");
+            exit (EXIT_FAILURE);
+        }
+    }
+}
+
+/* Open path for reading. BGZF input is inflated on nthreads threads
+   when nthreads > 1. Any other input is read ahead by a background
+   thread into INF_READ_AHEAD buffers of bufsize bytes each, unless
+   bufsize is 0, in which case it is read on the calling thread. */
+infile *infile_open (const char *path, int nthreads, size_t bufsize) {
+    infile *in;
+    FILE *fp;
+    size_t hdr;
+
+    fp = IS_STDIO (path) ? stdin : fopen (path, "rb");
+    if (!fp) return NULL;
+
+    in = (infile *) calloc (1, sizeof (infile));
+    in->fp = fp;
+    in->path = strdup (path);
+    in->buf = (unsigned char *) malloc (INF_BUF_SIZE);
+
+    in->mode = INF_PLAIN;
+    if (inf_fill (in, 2) && in->buf[0] == 0x1f && in->buf[1] == 0x8b) {
+        in->mode = INF_GZIP;
+        if (nthreads > 1 && bgzf_member_size (in, &hdr) > 0) in->mode = INF_BGZF;
+    }
+
+    inf_start (in, nthreads, bufsize);
+    return in;
+}
+
+/* Open path for reading from an access point recorded by an earlier
+   pass, or from the start if p is NULL, and drop the first skip bytes.
+   The input is inflated serially from there, even if it is BGZF, and
+   read ahead like infile_open() does. */
+infile *infile_open_at (const char *path, const infile_point *p, uint64_t skip, size_t bufsize) {
+    unsigned char *scratch;
+    uint64_t start = 0;
+    infile *in;
+    FILE *fp;
+    size_t n;
+
+    if (IS_STDIO (path)) return NULL;
+    fp = fopen (path, "rb");
+    if (!fp) return NULL;
+
+    in = (infile *) calloc (1, sizeof (infile));
+    in->fp = fp;
+    in->path = strdup (path);
+    in->buf = (unsigned char *) malloc (INF_BUF_SIZE);
+
+    in->mode = INF_PLAIN;
+    if (inf_fill (in, 2) && in->buf[0] == 0x1f && in->buf[1] == 0x8b) in->mode = INF_GZIP;
+
+    if (in->mode == INF_PLAIN) start = (p ? p->out : 0) + skip;
+    else if (p) start = p->in - (p->bits ? 1 : 0);
+
+    if (start > 0) {
+        if (fseeko (fp, start, SEEK_SET) != 0) inf_fail (in, "seek in");
+        in->beg = in->end = 0;
+        in->eof = 0;
+        in->foff = start;
+    }
+
+    if (in->mode == INF_GZIP && p) {
+        if (inflateInit2 (&in->z, -15) != Z_OK) inf_fail (in, "decompress");
+        in->z_ready = 1;
+        in->raw = 1;
+        if (p->bits) {
+            if (!inf_fill (in, 1)) inf_fail (in, "read");
+            inflatePrime (&in->z, p->bits, in->buf[in->beg++] >> (8 - p->bits));
+        }
+        if (p->wlen) inflateSetDictionary (&in->z, p->window, p->wlen);
+    }
+
+    if (in->mode == INF_GZIP && skip > 0) {
+        scratch = (unsigned char *) malloc (INF_BUF_SIZE);
+        while (skip > 0) {
+            n = inf_inflate (in, scratch, (skip < INF_BUF_SIZE) ? skip : INF_BUF_SIZE);
+            if (n == 0) break;
+            skip -= n;
+        }
+        free (scratch);
+    }
+
+    if (in->error) {
+        infile_close (in);
+        return NULL;
+    }
+
+    inf_start (in, 0, bufsize);
+    return in;
+}
+
+/* Record an access point every span bytes of output while reading.
+   Only for input read on the calling thread (bufsize 0, no BGZF
+   threads); the points are taken with infile_checkpoint(). */
+void infile_checkpoints (infile *in, uint64_t span) {
+    in->span = span;
+    in->last = 0;
+    if (!in->window) in->window = (unsigned char *) calloc (1, INFILE_WINDOW);
+}
+
+/* Take the oldest recorded access point if it is at or before out;
+   returns 0 if there is none. */
+int infile_checkpoint (infile *in, uint64_t out, infile_point *p) {
+    if (in->npoints == 0 || in->points[0].out > out) return 0;
+
+    *p = in->points[0];
+    memmove (in->points, in->points + 1, (in->npoints - 1) * sizeof (infile_point));
+    in->npoints--;
+    return 1;
+}
+
+/* the number of bytes infile_read() has handed out */
+uint64_t infile_tell (const infile *in) {
+    return in->out;
+}
+
+/* read up to len decompressed bytes, like gzread(); returns 0 at end of
+   file, and also from where the input could not be read */
+int infile_read (infile *in, void *buf, int len) {
+    char *p = (char *) buf;
+    size_t n;
+    int got = 0;
+
+    if (!in->q) {
+        uint64_t t0 = PROFILE_START ();
+
+        if (in->mode == INF_GZIP) n = inf_inflate (in, (unsigned char *) buf, len);
+        else n = inf_read_plain (in, (unsigned char *) buf, len);
+        PROFILE_STOP (PROF_READ, t0, 0, n);
+
+        /* every byte of a plain file is a place to start from */
+        if (in->span && in->mode == INF_PLAIN && n > 0 && in->out + n - in->last >= in->span) {
+            in->zout = in->out + n;
+            in->last = in->zout;
+            if (in->npoints == in->mpoints) {
+                in->mpoints = in->mpoints ? 2 * in->mpoints : 4;
+                in->points = (infile_point *) realloc (in->points, in->mpoints * sizeof (infile_point));
+            }
+            in->points[in->npoints].in = in->points[in->npoints].out = in->zout;
+            in->points[in->npoints].bits = in->points[in->npoints].wlen = 0;
+            in->npoints++;
+        }
+        in->out += n;
+        return n;
+    }
+
+    while (got < len) {
+        if (!in->cur) {
+            in->cur = (inf_job *) jobqueue_next (in->q);
+            if (!in->cur) break;
+        }
+
+        /* the data of a job that failed to inflate, or that was read after an error, is not handed out */
+        if (in->error) {
+            jobqueue_release (in->q);
+            in->cur = NULL;
+            break;
+        }
+
+        n = in->cur->outlen - in->cur->pos;
+        if (n > (size_t) (len - got)) n = len - got;
+        memcpy (p + got, in->cur->out + in->cur->pos, n);
+        in->cur->pos += n;
+        got += n;
+        in->out += n;
+
+        if (in->cur->pos == in->cur->outlen) {
+            jobqueue_release (in->q);
+            in->cur = NULL;
+        }
+    }
+
+    return got;
+}
+
+void infile_close (infile *in) {
+    int i;
+
+    if (!in) return;
+
+    if (in->q) {
+        /* the reader may still be running if we stopped early; let it drain */
+        in->stop = 1;
+        if (in->cur) jobqueue_release (in->q);
+        while (jobqueue_next (in->q)) jobqueue_release (in->q);
+        pthread_join (in->reader, NULL);
+        jobqueue_destroy (in->q);
+
+        for (i = 0; i <= in->nthreads; i++) {
+            if (in->zs_ready[i]) inflateEnd (&in->zs[i]);
+        }
+        for (i = 0; i < in->nslots; i++) {
+            free (in->jobs[i].in);
+            free (in->jobs[i].out);
+        }
+        free (in->zs);
+        free (in->zs_ready);
+        free (in->jobs);
+        free (in->jobp);
+    }
+
+    if (in->z_ready) inflateEnd (&in->z);
+    fclose (in->fp);
+    free (in->window);
+    free (in->points);
+    free (in->buf);
+    free (in->path);
+    free (in);
+}
+
+/* whether reading the file failed; the error has been reported */
+int infile_error (const infile *in) {
+    return in->error;
+}
+
+/* Map path into memory if it is a non-empty, uncompressed regular file.
+   Returns NULL otherwise (standard input, pipes, gzip input, mmap
+   failure), and the caller falls back to infile_open(). */
+const char *infile_map (const char *path, size_t *len) {
+    struct stat st;
+    unsigned char magic[2];
+    void *map;
+    int fd;
+
+    if (IS_STDIO (path)) return NULL;
+
+    fd = open (path, O_RDONLY);
+    if (fd < 0) return NULL;
+
+    if (fstat (fd, &st) != 0 || !S_ISREG (st.st_mode) || st.st_size < 2
+        || pread (fd, magic, 2, 0) != 2 || (magic[0] == 0x1f && magic[1] == 0x8b)) {
+        close (fd);
+        return NULL;
+    }
+
+    map = mmap (NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close (fd);
+    if (map == MAP_FAILED) return NULL;
+
+    madvise (map, st.st_size, MADV_SEQUENTIAL);
+    *len = st.st_size;
+    return (const char *) map;
+}
+
+void infile_unmap (const char *map, size_t len) {
+    if (map) munmap ((void *) map, len);
+}
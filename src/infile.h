@@ -0,0 +1,67 @@
+#ifndef INFILE_H
+#define INFILE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+/* Input file reader used by the kseq parser. Plain and gzip files are
+   detected from their first bytes. BGZF files (and any run of BGZF
+   members) are inflated in parallel: a reader thread splits the
+   compressed data at member boundaries using the block size stored in
+   each BC extra field, a pool of threads inflates the members, and
+   infile_read() hands the decompressed data back in file order. Other
+   gzip members only reveal where they end by being inflated, so they
+   are decompressed serially.
+
+   Input that is not inflated in parallel is read ahead instead: a
+   background thread keeps several large buffers of decompressed data
+   filled, so the parser only ever copies from memory.
+
+   Uncompressed files can also be mapped into memory whole with
+   infile_map(), so that callers can parse them in place.
+
+   The path "-" reads standard input, which works the same way (gzip
+   and BGZF are detected from the stream) except that it is never
+   mapped.
+
+   A gzip file can also be read from the middle, as zran.c in the zlib
+   sources does: while a file is read on the calling thread, infile can
+   record access points at deflate block boundaries, and
+   infile_open_at() starts inflating at one of them again. */
+
+typedef struct __infile_ infile;
+
+/* the history a deflate stream can refer back to */
+#define INFILE_WINDOW 32768
+
+/* An access point: the compressed offset of the first byte not fully
+   read, the bits of the byte before it that are still to be read, the
+   uncompressed offset, and the wlen bytes of output before it. In an
+   uncompressed file in and out are the same and there is no window. */
+typedef struct {
+    uint64_t in;
+    int bits;
+    uint64_t out;
+    int wlen;
+    unsigned char window[INFILE_WINDOW];
+} infile_point;
+
+/* "-" as a file name means standard input (or, for outputs, standard output) */
+#define IS_STDIO(path) (strcmp ((path), "-") == 0)
+
+/* default size in MB of each read-ahead buffer */
+#define INFILE_BUFFER_MB 4
+
+infile *infile_open (const char *path, int nthreads, size_t bufsize);
+int infile_read (infile *in, void *buf, int len);
+int infile_error (const infile *in);
+void infile_close (infile *in);
+infile *infile_open_at (const char *path, const infile_point *p, uint64_t skip, size_t bufsize);
+void infile_checkpoints (infile *in, uint64_t span);
+int infile_checkpoint (infile *in, uint64_t out, infile_point *p);
+uint64_t infile_tell (const infile *in);
+const char *infile_map (const char *path, size_t *len);
+void infile_unmap (const char *map, size_t len);
+
+#endif /* INFILE_H */
@@ -0,0 +1,303 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <pthread.h>
+#include "jobqueue.h"
+
+#define JOB_FREE 0
+#define JOB_FILLED 1
+#define JOB_BUSY 2
+#define JOB_DONE 3
+
+/* a queue of the pool with a job waiting to be taken, or NULL; the queues
+   take turns so that every one of them keeps moving */
+static jobqueue *jobpool_pick (jobpool *p) {
+    jobqueue *q;
+    int k;
+
+    for (k = 0; k < p->nqueues; k++) {
+        q = p->queues[(p->next + k) % p->nqueues];
+        if (q->taken < q->filled) {
+            p->next = (p->next + k + 1) % p->nqueues;
+            return q;
+        }
+    }
+    return NULL;
+}
+
+static void *jobpool_worker (void *data) {
+    jobpool *p = (jobpool *) data;
+    jobqueue *q;
+    int tid;
+    int slot;
+
+    pthread_mutex_lock (&p->lock);
+    /* worker ids start at 1; id 0 belongs to the consumer thread */
+    for (tid = 0; tid < p->nworkers; tid++) {
+        if (pthread_equal (p->workers[tid], pthread_self ())) break;
+    }
+    tid++;
+
+    for (;;) {
+        while (!(q = jobpool_pick (p)) && !p->closed) pthread_cond_wait (&p->cond, &p->lock);
+        if (!q) break;
+
+        slot = q->taken % q->nslots;
+        q->taken++;
+        q->state[slot] = JOB_BUSY;
+        pthread_mutex_unlock (&p->lock);
+
+        q->func (q->arg, q->jobs[slot], tid);
+
+        pthread_mutex_lock (&p->lock);
+        q->state[slot] = JOB_DONE;
+        pthread_cond_broadcast (&p->cond);
+    }
+
+    pthread_mutex_unlock (&p->lock);
+    return NULL;
+}
+
+/* Start a pool of nworkers threads (none for a queue whose consumer runs the jobs). */
+jobpool *jobpool_init (int nworkers) {
+    jobpool *p = (jobpool *) calloc (1, sizeof (jobpool));
+    int i;
+
+    p->nworkers = nworkers;
+    pthread_mutex_init (&p->lock, NULL);
+    pthread_cond_init (&p->cond, NULL);
+
+    if (nworkers > 0) {
+        p->workers = (pthread_t *) calloc (nworkers, sizeof (pthread_t));
+
+        /* hold the lock so that workers see the complete thread table */
+        pthread_mutex_lock (&p->lock);
+        for (i = 0; i < nworkers; i++) {
+            if (pthread_create (&p->workers[i], NULL, jobpool_worker, p) != 0) {
+                fprintf (stderr, "****Error: Could not start worker thread.\n\n");
+                exit (EXIT_FAILURE);
+            }
+        }
+        pthread_mutex_unlock (&p->lock);
+    }
+
+    return p;
+}
+
+/* Stop the workers once every queue has been emptied. */
+void jobpool_destroy (jobpool *p) {
+    int i;
+
+    if (!p) return;
+
+    pthread_mutex_lock (&p->lock);
+    p->closed = 1;
+    pthread_cond_broadcast (&p->cond);
+    pthread_mutex_unlock (&p->lock);
+    for (i = 0; i < p->nworkers; i++) pthread_join (p->workers[i], NULL);
+
+    pthread_mutex_destroy (&p->lock);
+    pthread_cond_destroy (&p->cond);
+    free (p->workers);
+    free (p->queues);
+    free (p);
+}
+
+/* Start a queue on the workers of pool, next to any other queues it runs. */
+jobqueue *jobqueue_init_pool (jobpool *pool, void **jobs, int nslots, job_func func, void *arg) {
+    jobqueue *q = (jobqueue *) calloc (1, sizeof (jobqueue));
+
+    q->pool = pool;
+    q->jobs = jobs;
+    q->nslots = nslots;
+    q->state = (int *) calloc (nslots, sizeof (int));
+    q->func = func;
+    q->arg = arg;
+    q->nworkers = pool->nworkers;
+
+    pthread_mutex_lock (&pool->lock);
+    pool->queues = (jobqueue **) realloc (pool->queues, (pool->nqueues + 1) * sizeof (jobqueue *));
+    pool->queues[pool->nqueues++] = q;
+    pthread_mutex_unlock (&pool->lock);
+
+    return q;
+}
+
+jobqueue *jobqueue_init (void **jobs, int nslots, int nworkers, job_func func, void *arg) {
+    jobqueue *q = jobqueue_init_pool (jobpool_init (nworkers), jobs, nslots, func, arg);
+
+    q->own_pool = 1;
+    return q;
+}
+
+/* Producer: wait for the next slot in fill order to become free */
+void *jobqueue_acquire (jobqueue *q) {
+    int slot = q->filled % q->nslots;
+
+    pthread_mutex_lock (&q->pool->lock);
+    while (q->state[slot] != JOB_FREE) pthread_cond_wait (&q->pool->cond, &q->pool->lock);
+    pthread_mutex_unlock (&q->pool->lock);
+
+    return q->jobs[slot];
+}
+
+void jobqueue_submit (jobqueue *q) {
+    pthread_mutex_lock (&q->pool->lock);
+    q->state[q->filled % q->nslots] = JOB_FILLED;
+    q->filled++;
+    pthread_cond_broadcast (&q->pool->cond);
+    pthread_mutex_unlock (&q->pool->lock);
+}
+
+void jobqueue_close (jobqueue *q) {
+    pthread_mutex_lock (&q->pool->lock);
+    q->closed = 1;
+    pthread_cond_broadcast (&q->pool->cond);
+    pthread_mutex_unlock (&q->pool->lock);
+}
+
+/* Consumer: wait for the oldest job to be processed. Returns NULL once
+   the producer has closed the queue and every job has been retired. */
+void *jobqueue_next (jobqueue *q) {
+    int slot;
+
+    pthread_mutex_lock (&q->pool->lock);
+    for (;;) {
+        if (q->retired == q->filled) {
+            if (q->closed) {
+                pthread_mutex_unlock (&q->pool->lock);
+                return NULL;
+            }
+            pthread_cond_wait (&q->pool->cond, &q->pool->lock);
+            continue;
+        }
+
+        slot = q->retired % q->nslots;
+
+        if (q->state[slot] == JOB_DONE) break;
+
+        if (q->nworkers == 0 && q->state[slot] == JOB_FILLED) {
+            q->state[slot] = JOB_BUSY;
+            q->taken++;
+            pthread_mutex_unlock (&q->pool->lock);
+            q->func (q->arg, q->jobs[slot], 0);
+            pthread_mutex_lock (&q->pool->lock);
+            q->state[slot] = JOB_DONE;
+            break;
+        }
+
+        pthread_cond_wait (&q->pool->cond, &q->pool->lock);
+    }
+    pthread_mutex_unlock (&q->pool->lock);
+
+    return q->jobs[slot];
+}
+
+void jobqueue_release (jobqueue *q) {
+    pthread_mutex_lock (&q->pool->lock);
+    q->state[q->retired % q->nslots] = JOB_FREE;
+    q->retired++;
+    pthread_cond_broadcast (&q->pool->cond);
+    pthread_mutex_unlock (&q->pool->lock);
+}
+
+/* jobs the workers have yet to take or finish */
+static int jobqueue_pending (jobqueue *q) {
+    int i;
+
+    if (q->taken < q->filled) return 1;
+    for (i = 0; i < q->nslots; i++) {
+        if (q->state[i] == JOB_BUSY) return 1;
+    }
+    return 0;
+}
+
+void jobqueue_destroy (jobqueue *q) {
+    jobpool *p;
+    int i;
+
+    if (!q) return;
+
+    jobqueue_close (q);
+
+    /* the workers finish what they have of this queue, as they would if it had a pool of its own */
+    p = q->pool;
+    pthread_mutex_lock (&p->lock);
+    while (q->nworkers > 0 && jobqueue_pending (q)) pthread_cond_wait (&p->cond, &p->lock);
+    for (i = 0; p->queues[i] != q; i++);
+    p->queues[i] = p->queues[--p->nqueues];
+    p->next = 0;
+    pthread_mutex_unlock (&p->lock);
+
+    if (q->own_pool) jobpool_destroy (p);
+    free (q->state);
+    free (q);
+}
+
+
+typedef struct {
+    jobqueue *q;
+    job_func drain;
+} drain_args;
+
+static void *jobqueue_drain (void *data) {
+    drain_args *d = (drain_args *) data;
+    void *job;
+
+    while ((job = jobqueue_next (d->q))) {
+        d->drain (d->q->arg, job, 0);
+        jobqueue_release (d->q);
+    }
+
+    return NULL;
+}
+
+/* fill q on the calling thread and drain it on a writer thread until fill() runs out */
+static int jobqueue_pump (jobqueue *q, job_fill_func fill, job_func drain, void *arg) {
+    drain_args d;
+    pthread_t writer;
+    void *job;
+
+    d.q = q;
+    d.drain = drain;
+
+    if (pthread_create (&writer, NULL, jobqueue_drain, &d) != 0) {
+        fprintf (stderr, "****Error: Could not start writer thread.\n\n");
+        exit (EXIT_FAILURE);
+    }
+
+    for (;;) {
+        job = jobqueue_acquire (q);
+        if (fill (arg, job) <= 0) break;
+        jobqueue_submit (q);
+    }
+
+    jobqueue_close (q);
+    pthread_join (writer, NULL);
+    jobqueue_destroy (q);
+
+    return 0;
+}
+
+/* Run a read -> work -> write pipeline over the given job objects.
+   fill() is called on the calling thread and returns 0 at end of input,
+   work() runs on the worker pool, and drain() runs on a dedicated
+   writer thread in input order. With no workers everything runs on the
+   calling thread, one job at a time. */
+int jobqueue_run (void **jobs, int nslots, int nworkers, job_fill_func fill, job_func work, job_func drain, void *arg) {
+    if (nworkers <= 0) {
+        while (fill (arg, jobs[0]) > 0) {
+            work (arg, jobs[0], 0);
+            drain (arg, jobs[0], 0);
+        }
+        return 0;
+    }
+
+    return jobqueue_pump (jobqueue_init (jobs, nslots, nworkers, work, arg), fill, drain, arg);
+}
+
+/* The same pipeline, with work() run by the workers of a pool that other
+   pipelines may be using at the same time. Worker ids are those of the
+   pool. */
+int jobqueue_run_pool (jobpool *pool, void **jobs, int nslots, job_fill_func fill, job_func work, job_func drain, void *arg) {
+    return jobqueue_pump (jobqueue_init_pool (pool, jobs, nslots, work, arg), fill, drain, arg);
+}
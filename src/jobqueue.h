@@ -0,0 +1,68 @@
+#ifndef JOBQUEUE_H
+#define JOBQUEUE_H
+
+#include <pthread.h>
+
+/* A jobqueue is a fixed ring of job slots. One producer fills the
+   slots in order, a pool of worker threads processes them in any
+   order, and one consumer retires them in the order they were
+   filled. The caller owns the job objects; the queue only hands
+   pointers around, so nothing is allocated per job.
+
+   With zero workers, jobqueue_next() runs the job function itself,
+   so the same code drives both the serial and the threaded case.
+
+   The workers belong to a jobpool. A queue started with jobqueue_init()
+   gets a pool of its own; queues started with jobqueue_init_pool() share
+   one, and a worker with nothing to do takes the next job of whichever
+   queue has one, going round the queues in turn. All the queues of a
+   pool share its lock and condition variable.
+*/
+
+typedef void (*job_func) (void *arg, void *job, int tid);
+typedef int (*job_fill_func) (void *arg, void *job);
+
+typedef struct __jobqueue_ jobqueue;
+
+typedef struct __jobpool_ {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    jobqueue **queues;  /* the queues the workers take jobs from */
+    int nqueues;
+    int next;           /* the queue to look at first */
+    int closed;
+    pthread_t *workers;
+    int nworkers;
+} jobpool;
+
+struct __jobqueue_ {
+    jobpool *pool;
+    int own_pool;       /* the pool was started for this queue alone */
+    void **jobs;
+    int *state;
+    int nslots;
+    long filled;        /* jobs submitted by the producer */
+    long taken;         /* jobs picked up by a worker */
+    long retired;       /* jobs released by the consumer */
+    int closed;
+    job_func func;
+    void *arg;
+    int nworkers;
+};
+
+jobpool *jobpool_init (int nworkers);
+void jobpool_destroy (jobpool *p);
+
+jobqueue *jobqueue_init (void **jobs, int nslots, int nworkers, job_func func, void *arg);
+jobqueue *jobqueue_init_pool (jobpool *pool, void **jobs, int nslots, job_func func, void *arg);
+void *jobqueue_acquire (jobqueue *q);
+void jobqueue_submit (jobqueue *q);
+void jobqueue_close (jobqueue *q);
+void *jobqueue_next (jobqueue *q);
+void jobqueue_release (jobqueue *q);
+void jobqueue_destroy (jobqueue *q);
+
+int jobqueue_run (void **jobs, int nslots, int nworkers, job_fill_func fill, job_func work, job_func drain, void *arg);
+int jobqueue_run_pool (jobpool *pool, void **jobs, int nslots, job_fill_func fill, job_func work, job_func drain, void *arg);
+
+#endif /* JOBQUEUE_H */
@@ -0,0 +1,215 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <glob.h>
+#include <sys/stat.h>
+#include "lanes.h"
+#include "fqindex.h"
+
+lanes *lanes_init (int mates) {
+    lanes *l = (lanes *) calloc (1, sizeof (lanes));
+
+    l->mates = mates;
+    return l;
+}
+
+static void lanes_push (lanes *l, int mate, const char *path) {
+    l->path[mate] = (char **) realloc (l->path[mate], (l->npath[mate] + 1) * sizeof (char *));
+    l->path[mate][l->npath[mate]++] = strdup (path);
+}
+
+/* Add the files of an input option to those of mate: a comma separated
+   list of files and glob patterns. Exits if a pattern matches nothing. */
+void lanes_add (lanes *l, int mate, const char *arg) {
+    char *list = strdup (arg), *item, *next;
+    glob_t g;
+    size_t i;
+
+    for (item = list; item; item = next) {
+        next = strchr (item, ',');
+        if (next) *next++ = '\0';
+        if (!*item) continue;
+
+        if (!strpbrk (item, "*?[")) {
+            lanes_push (l, mate, item);
+            continue;
+        }
+        if (glob (item, 0, NULL, &g) != 0) {
+            fprintf (stderr, "****Error: No input files match '%s'.\n\n", item);
+            exit (EXIT_FAILURE);
+        }
+        for (i = 0; i < g.gl_pathc; i++) lanes_push (l, mate, g.gl_pathv[i]);
+        globfree (&g);
+    }
+    free (list);
+}
+
+/* Open every file, sharing nthreads inflate threads between the lanes.
+   All mates must have the same number of files. Returns NULL, or the
+   file that could not be opened. */
+const char *lanes_open (lanes *l, int order, int nthreads, size_t bufsize) {
+    int per_lane, i, m;
+
+    l->n = l->npath[0];
+    l->order = order;
+    per_lane = (nthreads + l->n - 1) / l->n;
+
+    l->live = (int *) malloc (l->n * sizeof (int));
+    for (m = 0; m < l->mates; m++) l->in[m] = (infile **) calloc (l->n, sizeof (infile *));
+
+    for (i = 0; i < l->n; i++) {
+        for (m = 0; m < l->mates; m++) {
+            l->in[m][i] = infile_open (l->path[m][i], per_lane, bufsize);
+            if (!l->in[m][i]) return l->path[m][i];
+        }
+        l->live[i] = i;
+    }
+    l->nlive = l->n;
+    l->cur = 0;
+    return NULL;
+}
+
+/* Open the share k (1 .. n) of the records of the one file of each
+   mate, split between pairs if the mates are interleaved. Sets skip[]
+   to the records to drop from each mate before the share starts, and
+   count to the records (pairs of mates) in it, which may be none, or
+   to LANES_TO_END for the last share. Returns -1, after reporting why,
+   if there is not one indexed file per mate, if the files of the two
+   mates differ in length or if one could not be opened; else 0. */
+int lanes_open_region (lanes *l, int k, int n, int interleaved, size_t bufsize, uint64_t *skip, uint64_t *count) {
+    fqindex *x[2] = {NULL, NULL};
+    uint64_t units, first, unit = interleaved ? 2 : 1;
+    const char *bad = NULL;
+    int m;
+
+    for (m = 0; m < l->mates; m++) {
+        if (l->npath[m] != 1) {
+            fprintf (stderr, "****Error: --region needs one input file per mate.\n\n");
+            fqindex_destroy (x[0]);
+            return -1;
+        }
+        x[m] = fqindex_load (l->path[m][0]);
+        if (!x[m]) {
+            fqindex_destroy (x[0]);
+            return -1;
+        }
+    }
+    if (l->mates == 2 && x[0]->records != x[1]->records) {
+        fprintf (stderr, "****Error: '%s' has %" PRIu64 " records and '%s' has %" PRIu64 "; regions would split the pairs.\n\n",
+            l->path[0][0], x[0]->records, l->path[1][0], x[1]->records);
+        fqindex_destroy (x[0]);
+        fqindex_destroy (x[1]);
+        return -1;
+    }
+
+    /* the last share also takes anything the index did not count */
+    units = x[0]->records / unit;
+    first = units * (k - 1) / n;
+    *count = (k == n) ? LANES_TO_END : units * k / n - first;
+
+    l->n = 1;
+    l->order = LANES_CONCAT;
+    l->live = (int *) malloc (sizeof (int));
+    l->live[0] = 0;
+    l->nlive = 1;
+    l->cur = 0;
+    for (m = 0; m < l->mates; m++) {
+        l->in[m] = (infile **) calloc (1, sizeof (infile *));
+        l->in[m][0] = fqindex_open (x[m], l->path[m][0], first * unit, bufsize, &skip[m]);
+        if (!l->in[m][0] && !bad) bad = l->path[m][0];
+        fqindex_destroy (x[m]);
+    }
+    if (bad) {
+        fprintf (stderr, "****Error: Could not open input file '%s'.\n\n", bad);
+        return -1;
+    }
+    return 0;
+}
+
+/* whether reading any of the files failed; the error has been reported */
+int lanes_error (const lanes *l) {
+    int i, m;
+
+    for (m = 0; m < l->mates; m++) {
+        for (i = 0; l->in[m] && i < l->n; i++) {
+            if (l->in[m][i] && infile_error (l->in[m][i])) return 1;
+        }
+    }
+    return 0;
+}
+
+/* the lane to read from, or -1 once all of them are read */
+int lanes_current (const lanes *l) {
+    return l->nlive ? l->live[l->cur] : -1;
+}
+
+/* the current lane is read to the end; the next one takes its place */
+void lanes_finish (lanes *l) {
+    memmove (l->live + l->cur, l->live + l->cur + 1, (l->nlive - l->cur - 1) * sizeof (int));
+    l->nlive--;
+    if (l->cur >= l->nlive) l->cur = 0;
+}
+
+/* a batch has been read: interleaved lanes hand over to the next one */
+void lanes_next (lanes *l) {
+    if (l->order == LANES_INTERLEAVE && l->nlive) l->cur = (l->cur + 1) % l->nlive;
+}
+
+/* whether path is one of the input files (standard input never is) */
+int lanes_has (const lanes *l, const char *path) {
+    int i, m;
+
+    if (IS_STDIO (path)) return 0;
+    for (m = 0; m < l->mates; m++) {
+        for (i = 0; i < l->npath[m]; i++) {
+            if (!strcmp (l->path[m][i], path)) return 1;
+        }
+    }
+    return 0;
+}
+
+/* the files of mate, separated by commas */
+void lanes_print (FILE *f, const lanes *l, int mate) {
+    int i;
+
+    for (i = 0; i < l->npath[mate]; i++) fprintf (f, "%s%s", i ? ", " : "", l->path[mate][i]);
+}
+
+/* the bytes in all the files that can be found */
+uint64_t lanes_size (const lanes *l) {
+    struct stat st;
+    uint64_t size = 0;
+    int i, m;
+
+    for (m = 0; m < l->mates; m++) {
+        for (i = 0; i < l->npath[m]; i++) {
+            if (stat (l->path[m][i], &st) == 0) size += st.st_size;
+        }
+    }
+    return size;
+}
+
+/* K/N, the K-th (from 1) of N regions */
+int lanes_parse_region (const char *arg, int *k, int *n) {
+    char c;
+
+    return sscanf (arg, "%d/%d%c", k, n, &c) == 2 && *k >= 1 && *k <= *n;
+}
+
+void lanes_close (lanes *l) {
+    int i, m;
+
+    if (!l) return;
+
+    for (m = 0; m < l->mates; m++) {
+        for (i = 0; i < l->npath[m]; i++) {
+            if (l->in[m]) infile_close (l->in[m][i]);
+            free (l->path[m][i]);
+        }
+        free (l->in[m]);
+        free (l->path[m]);
+    }
+    free (l->live);
+    free (l);
+}
@@ -0,0 +1,67 @@
+#ifndef LANES_H
+#define LANES_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "infile.h"
+
+/* Input in lanes: a sample sequenced on several lanes comes as several
+   files (..._L001_R1.fastq.gz ... _L004_R1.fastq.gz) that are trimmed
+   as one. An input option takes a comma separated list of files, glob
+   patterns (expanded in sorted order) or both, and can be given more
+   than once. Every file is an infile of its own, so every lane has its
+   own reader thread decompressing ahead of the parser. Paired input has
+   two files per lane, the forward and the reverse reads, and the n-th
+   forward file is read with the n-th reverse file.
+
+   The reader takes its records from one lane at a time:
+
+     LANES_CONCAT      all of a lane before the next one, so the records
+                       come in the order of the files cat'ed together
+     LANES_INTERLEAVE  a batch from each lane in turn, so that all the
+                       lanes are decompressed at the same time rather
+                       than one lane and the read-ahead of the next;
+                       the order only depends on the batch size
+
+   A lane ends at its end of file or at a truncated record, and the
+   reader goes on with the next.
+
+   With --region K/N there is one file per mate, opened by its record
+   index (fqindex.h) at the start of the K-th of N shares of its records
+   or, for interleaved mates, of its pairs. */
+
+typedef enum {
+  LANES_CONCAT,
+  LANES_INTERLEAVE
+} lanes_order;
+
+/* the count of the last region, which reads to the end of the file */
+#define LANES_TO_END UINT64_MAX
+
+typedef struct {
+    int mates;          /* files per lane: 1, or 2 for forward and reverse */
+    char **path[2];     /* the files of each mate */
+    int npath[2];
+    infile **in[2];     /* open files, by lane */
+    int n;              /* lanes */
+    int order;
+    int *live;          /* the lanes not read to the end, in order */
+    int nlive;
+    int cur;            /* the lane being read, an index into live */
+} lanes;
+
+lanes *lanes_init (int mates);
+void lanes_add (lanes *l, int mate, const char *arg);
+const char *lanes_open (lanes *l, int order, int nthreads, size_t bufsize);
+int lanes_open_region (lanes *l, int k, int n, int interleaved, size_t bufsize, uint64_t *skip, uint64_t *count);
+int lanes_error (const lanes *l);
+int lanes_current (const lanes *l);
+void lanes_finish (lanes *l);
+void lanes_next (lanes *l);
+int lanes_has (const lanes *l, const char *path);
+void lanes_print (FILE *f, const lanes *l, int mate);
+uint64_t lanes_size (const lanes *l);
+void lanes_close (lanes *l);
+int lanes_parse_region (const char *arg, int *k, int *n);
+
+#endif /* LANES_H */
@@ -0,0 +1,200 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include "outshard.h"
+#include "outsink.h"
+
+struct __outshard_ {
+    int noutputs;
+    int nshards;
+    int mode;
+    outsink **sink;         /* shard i of output k is sink[i * noutputs + k], NULL if output k is unused */
+    char **path;            /* indexed like sink */
+    const char **names;
+    const int *unit_records;
+    uint64_t *records;      /* indexed like sink */
+    uint64_t *bytes;        /* indexed like sink */
+    uint64_t *shard_bytes;  /* all outputs of shard i */
+    uint64_t next;          /* units handed out so far, for SHARD_RECORDS */
+    size_t *zero;           /* where the first unit of a batch starts */
+    char *manifest;
+};
+
+/* out.fq.gz -> out.<i>.fq.gz: the index goes before the extension, and
+   is zero-padded so that the shards sort in order */
+static char *outshard_path (const char *path, int i, int nshards) {
+    const char *slash = strrchr (path, '/'), *base = slash ? slash + 1 : path, *ext, *gz;
+    size_t len = strlen (path);
+    int width = 1, n, k;
+    char *p;
+
+    for (n = nshards - 1; n >= 10; n /= 10) width++;
+
+    gz = path + len;
+    if (len >= 3 && !strcmp (path + len - 3, ".gz")) gz = path + len - 3;
+    for (ext = gz; ext > base && ext[-1] != '.'; ext--);
+    ext = (ext > base + 1) ? ext - 1 : gz;
+
+    n = ext - path;
+    p = (char *) malloc (len + width + 2);
+    memcpy (p, path, n);
+    p[n++] = '.';
+    for (k = width - 1; k >= 0; k--, i /= 10) p[n + k] = '0' + i % 10;
+    strcpy (p + n + width, ext);
+    return p;
+}
+
+static void outshard_free (outshard *s) {
+    int j;
+
+    for (j = 0; j < s->nshards * s->noutputs; j++) free (s->path[j]);
+    free (s->sink);
+    free (s->path);
+    free (s->records);
+    free (s->bytes);
+    free (s->shard_bytes);
+    free (s->zero);
+    free (s->manifest);
+    free (s);
+}
+
+/* Open nshards shards of each output k with paths[k] set. names[k] is
+   what the manifest calls output k, and unit_records[k] the number of
+   records a unit holds in it. Compressed shards are deflated on the
+   nthreads threads that all gzip outputs share (gzwriter.h). Returns
+   NULL, after reporting it, if a shard cannot be created. */
+outshard *outshard_open (const char **paths, const char **names, const int *unit_records, int noutputs, int nshards, int mode,
+    int gzip, int nthreads, int format, int index) {
+    outshard *s = (outshard *) calloc (1, sizeof (outshard));
+    int i, k, j;
+
+    s->noutputs = noutputs;
+    s->nshards = nshards;
+    s->mode = mode;
+    s->names = names;
+    s->unit_records = unit_records;
+    s->sink = (outsink **) calloc (nshards * noutputs, sizeof (outsink *));
+    s->path = (char **) calloc (nshards * noutputs, sizeof (char *));
+    s->records = (uint64_t *) calloc (nshards * noutputs, sizeof (uint64_t));
+    s->bytes = (uint64_t *) calloc (nshards * noutputs, sizeof (uint64_t));
+    s->shard_bytes = (uint64_t *) calloc (nshards, sizeof (uint64_t));
+    s->zero = (size_t *) calloc (noutputs, sizeof (size_t));
+
+    for (k = 0; k < noutputs; k++) {
+        if (!paths[k]) continue;
+        if (!s->manifest) {
+            s->manifest = (char *) malloc (strlen (paths[k]) + 12);
+            sprintf (s->manifest, "%s.shards.tsv", paths[k]);
+        }
+
+        for (i = 0; i < nshards; i++) {
+            j = i * noutputs + k;
+            s->path[j] = outshard_path (paths[k], i, nshards);
+            s->sink[j] = outsink_open (s->path[j], gzip, nthreads, format, index);
+            if (!s->sink[j]) {
+                fprintf (stderr, "****Error: Could not open output file '%s'.\n\n", s->path[j]);
+                for (j = 0; j < nshards * noutputs; j++) outsink_close (s->sink[j]);
+                outshard_free (s);
+                return NULL;
+            }
+        }
+    }
+
+    return s;
+}
+
+/* the shard that unit gets */
+static int outshard_pick (outshard *s) {
+    int i, best = 0;
+
+    if (s->mode == SHARD_RECORDS) return s->next++ % s->nshards;
+
+    for (i = 1; i < s->nshards; i++) {
+        if (s->shard_bytes[i] < s->shard_bytes[best]) best = i;
+    }
+    return best;
+}
+
+/* copy out[k][from[k], to[k]) of every output to shard i */
+static void outshard_copy (outshard *s, int i, kstring_t *out, const size_t *from, const size_t *to) {
+    int k;
+
+    for (k = 0; k < s->noutputs; k++) {
+        if (s->sink[i * s->noutputs + k] && to[k] > from[k]) outsink_write (s->sink[i * s->noutputs + k], out[k].s + from[k], to[k] - from[k]);
+    }
+}
+
+/* Hand over a batch: out[k] is the formatted output for output k, and
+   mark[u * noutputs + k] is where unit u ends in it. Units that wrote
+   nothing (both mates discarded) do not take a turn. Consecutive units
+   for the same shard are written in one piece. */
+void outshard_write (outshard *s, kstring_t *out, const size_t *mark, int nunits) {
+    const size_t *start = s->zero, *prev = s->zero, *end;
+    size_t len, total;
+    int u, k, i, cur = -1;
+
+    for (u = 0; u < nunits; u++, prev = end) {
+        end = mark + u * s->noutputs;
+        for (k = 0, total = 0; k < s->noutputs; k++) total += end[k] - prev[k];
+        if (total == 0) continue;
+
+        i = outshard_pick (s);
+        if (i != cur) {
+            if (cur >= 0) outshard_copy (s, cur, out, start, prev);
+            cur = i;
+            start = prev;
+        }
+
+        for (k = 0; k < s->noutputs; k++) {
+            len = end[k] - prev[k];
+            if (!len) continue;
+            s->records[i * s->noutputs + k] += s->unit_records[k];
+            s->bytes[i * s->noutputs + k] += len;
+        }
+        s->shard_bytes[i] += total;
+    }
+
+    if (cur >= 0) outshard_copy (s, cur, out, start, prev);
+}
+
+/* Close every shard and write the manifest. Returns -1 if a shard or
+   the manifest could not be written (which has been reported), else 0. */
+int outshard_close (outshard *s) {
+    FILE *fp;
+    int i, k, j, ret = 0;
+
+    if (!s) return 0;
+
+    for (j = 0; j < s->nshards * s->noutputs; j++) {
+        if (outsink_close (s->sink[j]) != 0) ret = -1;
+    }
+
+    /* no manifest lists shards that were not written in full */
+    if (ret) {
+        outshard_free (s);
+        return -1;
+    }
+
+    fp = fopen (s->manifest, "w");
+    if (!fp) {
+        fprintf (stderr, "****Error: Could not open shard manifest '%s'.\n\n", s->manifest);
+        outshard_free (s);
+        return -1;
+    }
+    fprintf (fp, "shard\toutput\tfile\trecords\tbytes\n");
+    for (i = 0; i < s->nshards; i++) {
+        for (k = 0; k < s->noutputs; k++) {
+            j = i * s->noutputs + k;
+            if (!s->path[j]) continue;
+            fprintf (fp, "%d\t%s\t%s\t%" PRIu64 "\t%" PRIu64 "\n", i, s->names[k], s->path[j], s->records[j], s->bytes[j]);
+        }
+    }
+    if (fclose (fp) != 0) {
+        fprintf (stderr, "****Error: Could not write shard manifest '%s'.\n\n", s->manifest);
+        ret = -1;
+    }
+
+    outshard_free (s);
+    return ret;
+}
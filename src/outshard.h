@@ -0,0 +1,37 @@
+#ifndef OUTSHARD_H
+#define OUTSHARD_H
+
+#include <stdint.h>
+#include "sickle.h"
+
+/* Sharded output: every output file is split into nshards files, for
+   tools that run one job per chunk. The writer hands over a batch's
+   formatted output a unit at a time (a record for single-end input, a
+   pair for paired-end), and every unit goes to one shard index in all
+   the outputs at once, so mates in pe1/pe2 shard i stay in step.
+
+     SHARD_RECORDS  units go to the shards in turn (round-robin)
+     SHARD_BYTES    each unit goes to the shard that has the fewest
+                    bytes so far, which balances the shard sizes when
+                    trimming leaves reads of very different lengths
+
+   Shard i of out.fq.gz is out.<i>.fq.gz. Each shard is an outsink of
+   its own, and the blocks of all the compressed shards are deflated in
+   parallel on the shared compression threads. When the shards are
+   closed, a manifest of their names, record counts and (uncompressed)
+   sizes is written next to the first output as
+   <output>.shards.tsv. */
+
+typedef enum {
+  SHARD_RECORDS,
+  SHARD_BYTES
+} outshard_mode;
+
+typedef struct __outshard_ outshard;
+
+outshard *outshard_open (const char **paths, const char **names, const int *unit_records, int noutputs, int nshards, int mode,
+    int gzip, int nthreads, int format, int index);
+void outshard_write (outshard *s, kstring_t *out, const size_t *mark, int nunits);
+int outshard_close (outshard *s);
+
+#endif /* OUTSHARD_H */
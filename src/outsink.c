@@ -0,0 +1,92 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "outsink.h"
+#include "gzwriter.h"
+
+struct __outsink_ {
+    FILE *fp;               /* plain output */
+    gzwriter *gz;           /* compressed output */
+    char *path;
+    char *buf;
+    size_t len;
+    int error;              /* a write failed; the rest is dropped */
+};
+
+static void outsink_fail (outsink *o) {
+    if (!o->error) fprintf (stderr, "****Error: Could not write output file '%s'.\n\n", o->path);
+    o->error = 1;
+}
+
+static void outsink_flush (outsink *o, const char *buf, size_t len) {
+    if (len > 0 && !o->error && fwrite (buf, 1, len, o->fp) != len) outsink_fail (o);
+}
+
+/* Open path for writing ("-" for standard output), compressed with
+   gzwriter in the given format when gzip is set. Returns NULL if the
+   file cannot be created. */
+outsink *outsink_open (const char *path, int gzip, int nthreads, int format, int index) {
+    outsink *o = (outsink *) calloc (1, sizeof (outsink));
+
+    if (gzip) {
+        o->gz = gzwriter_open (path, nthreads, format, index);
+        if (!o->gz) {
+            free (o);
+            return NULL;
+        }
+    } else {
+        o->fp = strcmp (path, "-") ? fopen (path, "w") : stdout;
+        if (!o->fp) {
+            free (o);
+            return NULL;
+        }
+        /* everything reaches stdio in large pieces already */
+        setvbuf (o->fp, NULL, _IONBF, 0);
+        o->buf = (char *) malloc (OUTSINK_BUFFER_SIZE);
+    }
+
+    o->path = strdup (path);
+    return o;
+}
+
+void outsink_write (outsink *o, const char *buf, size_t len) {
+    if (o->gz) {
+        gzwriter_write (o->gz, buf, len);
+        return;
+    }
+
+    if (o->len + len > OUTSINK_BUFFER_SIZE) {
+        outsink_flush (o, o->buf, o->len);
+        o->len = 0;
+
+        /* no point copying what fills the buffer by itself */
+        if (len >= OUTSINK_BUFFER_SIZE) {
+            outsink_flush (o, buf, len);
+            return;
+        }
+    }
+
+    memcpy (o->buf + o->len, buf, len);
+    o->len += len;
+}
+
+/* Returns -1 if anything could not be written (which has been
+   reported), else 0. */
+int outsink_close (outsink *o) {
+    int ret;
+
+    if (!o) return 0;
+
+    if (o->gz) {
+        if (gzwriter_close (o->gz) != 0) o->error = 1;
+    } else {
+        outsink_flush (o, o->buf, o->len);
+        if (fclose (o->fp) != 0) outsink_fail (o);
+    }
+
+    ret = o->error ? -1 : 0;
+    free (o->buf);
+    free (o->path);
+    free (o);
+    return ret;
+}
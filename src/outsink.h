@@ -0,0 +1,21 @@
+#ifndef OUTSINK_H
+#define OUTSINK_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+/* Output file for trimmed records. Records are formatted into memory
+   by print_record() and handed over here in large pieces, which are
+   either written out in big unbuffered writes (plain output) or passed
+   to the block-parallel gzip/BGZF writer (gzwriter.h). */
+
+/* bytes of plain output collected before they are written */
+#define OUTSINK_BUFFER_SIZE (1024 * 1024)
+
+typedef struct __outsink_ outsink;
+
+outsink *outsink_open (const char *path, int gzip, int nthreads, int format, int index);
+void outsink_write (outsink *o, const char *buf, size_t len);
+int outsink_close (outsink *o);
+
+#endif /* OUTSINK_H */
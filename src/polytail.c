@@ -0,0 +1,158 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include "polytail.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define POLYTAIL_SIMD 1
+#endif
+
+typedef int (*polytail_run_fn) (const char *s, int len, char x);
+
+static polytail_run_fn run;
+
+/* bit i is set where s[i] (0 <= i < n) is not x in either case */
+static uint64_t polytail_mask_scalar (const char *s, int n, char x) {
+    uint64_t m = 0;
+    int i;
+
+    for (i = 0; i < n; i++) {
+        if ((s[i] | 0x20) != x) m |= 1ULL << i;
+    }
+    return m;
+}
+
+static uint64_t polytail_mask_generic (const char *s, char x) {
+    return polytail_mask_scalar (s, 64, x);
+}
+
+/* Every kernel walks the read the same way, 64 characters at a time from
+   the 3' end; only isa_mask (s, x), the mask of the 64 characters from s
+   on that are not x, differs. The best tail starts just after another
+   base (or at 0), so the score only needs to be looked at there: top is
+   where the run of x before the last other base seen starts. Returns
+   where the best scoring tail starts, len if none scores above 0. */
+#define POLYTAIL_KERNEL(isa)                                            \
+static int polytail_run_##isa (const char *s, int len, char x) {        \
+    int j = len, top = len, w, q, score = 0, best = 0, best_t = len;    \
+    uint64_t m;                                                         \
+                                                                        \
+    while (j > 0) {                                                     \
+        w = (j < 64) ? j : 64;                                          \
+        m = (w == 64) ? polytail_mask_##isa (s + j - 64, x) : polytail_mask_scalar (s, w, x); \
+        while (m) {                                                     \
+            q = 63 - __builtin_clzll (m);                               \
+            m &= ~(1ULL << q);                                          \
+            q += j - w;                                                 \
+            score += top - (q + 1);                                     \
+            if (score > best) {                                         \
+                best = score;                                           \
+                best_t = q + 1;                                         \
+            }                                                           \
+            score -= POLYTAIL_MISMATCH_PENALTY;                         \
+            if (score < best - POLYTAIL_MAX_DROP) return best_t;        \
+            top = q;                                                    \
+        }                                                               \
+        j -= w;                                                         \
+    }                                                                   \
+    return (score + top > best) ? 0 : best_t;                           \
+}
+
+POLYTAIL_KERNEL (generic)
+
+#ifdef POLYTAIL_SIMD
+
+__attribute__((target ("sse2")))
+static uint64_t polytail_mask_sse2 (const char *s, char x) {
+    __m128i v = _mm_set1_epi8 (x), lc = _mm_set1_epi8 (0x20), c;
+    uint64_t m = 0;
+    int i;
+
+    for (i = 0; i < 4; i++) {
+        c = _mm_or_si128 (_mm_loadu_si128 ((const __m128i *) (s + 16 * i)), lc);
+        m |= (uint64_t) (uint16_t) _mm_movemask_epi8 (_mm_cmpeq_epi8 (c, v)) << (16 * i);
+    }
+    return ~m;
+}
+
+__attribute__((target ("avx2")))
+static uint64_t polytail_mask_avx2 (const char *s, char x) {
+    __m256i v = _mm256_set1_epi8 (x), lc = _mm256_set1_epi8 (0x20);
+    __m256i lo = _mm256_or_si256 (_mm256_loadu_si256 ((const __m256i *) s), lc);
+    __m256i hi = _mm256_or_si256 (_mm256_loadu_si256 ((const __m256i *) (s + 32)), lc);
+    uint64_t m = (uint32_t) _mm256_movemask_epi8 (_mm256_cmpeq_epi8 (lo, v));
+
+    m |= (uint64_t) (uint32_t) _mm256_movemask_epi8 (_mm256_cmpeq_epi8 (hi, v)) << 32;
+    return ~m;
+}
+
+__attribute__((target ("avx512f,avx512bw")))
+static uint64_t polytail_mask_avx512 (const char *s, char x) {
+    __m512i c = _mm512_or_si512 (_mm512_loadu_si512 ((const void *) s), _mm512_set1_epi8 (0x20));
+
+    return _mm512_cmpneq_epi8_mask (c, _mm512_set1_epi8 (x));
+}
+
+__attribute__((target ("sse2")))
+POLYTAIL_KERNEL (sse2)
+
+__attribute__((target ("avx2")))
+POLYTAIL_KERNEL (avx2)
+
+__attribute__((target ("avx512f,avx512bw")))
+POLYTAIL_KERNEL (avx512)
+
+#endif
+
+/* Clip tails of the bases in bases (any of A, C, G and T) that are at
+   least min_length long. Returns NULL, after reporting it, on any other
+   base. */
+polytail *polytail_init (const char *bases, int min_length) {
+    polytail *p = (polytail *) calloc (1, sizeof (polytail));
+    const char *b;
+    char x;
+    int i;
+
+    for (b = bases; *b; b++) {
+        x = *b | 0x20;
+        if (!strchr ("acgt", x) || p->n == 4) {
+            fprintf (stderr, "****Error: Poly tail bases '%s' must be some of A, C, G and T.\n\n", bases);
+            free (p);
+            return NULL;
+        }
+        for (i = 0; i < p->n && p->base[i] != x; i++);
+        if (i == p->n) p->base[p->n++] = x;
+    }
+    if (p->n == 0) {
+        fprintf (stderr, "****Error: Poly tail bases '%s' must be some of A, C, G and T.\n\n", bases);
+        free (p);
+        return NULL;
+    }
+    p->min_length = (min_length > 0) ? min_length : 1;
+
+    run = polytail_run_generic;
+#ifdef POLYTAIL_SIMD
+    __builtin_cpu_init ();
+    if (__builtin_cpu_supports ("avx512f") && __builtin_cpu_supports ("avx512bw")) run = polytail_run_avx512;
+    else if (__builtin_cpu_supports ("avx2")) run = polytail_run_avx2;
+    else if (__builtin_cpu_supports ("sse2")) run = polytail_run_sse2;
+#endif
+    return p;
+}
+
+void polytail_destroy (polytail *p) {
+    free (p);
+}
+
+/* where the longest tail of any of the bases in s[0, len) starts, or len if it has none */
+int polytail_find (const polytail *p, const char *s, int len) {
+    int best = len, i, t;
+
+    for (i = 0; i < p->n; i++) {
+        t = run (s, len, p->base[i]);
+        if (len - t >= p->min_length && t < best) best = t;
+    }
+    return best;
+}
@@ -0,0 +1,33 @@
+#ifndef POLYTAIL_H
+#define POLYTAIL_H
+
+/* Poly-X tail detection. Two-colour chemistries (NextSeq, NovaSeq) read
+   "no signal" as G with high quality, so reads that run past the end of
+   the fragment end in runs of G that the quality windows never cut.
+
+   The tail of a read is the 3' end that scores best for one of the
+   given bases, counting +1 for the base and -POLYTAIL_MISMATCH_PENALTY
+   for any other, so that sequencing errors inside the run are kept in
+   it while the bases before it (which are mostly other bases) are not.
+   The search from the 3' end gives up once the score has fallen
+   POLYTAIL_MAX_DROP below the best so far. A tail is clipped when it is
+   at least min_length long.
+
+   The read is compared with the base 64 characters at a time with the
+   widest vector compare the CPU has; a block with no other base in it
+   costs one compare and one test. */
+
+#define POLYTAIL_MISMATCH_PENALTY 4
+#define POLYTAIL_MAX_DROP 8
+
+typedef struct {
+    int n;
+    char base[4];   /* the bases whose tails are clipped, lower case */
+    int min_length;
+} polytail;
+
+polytail *polytail_init (const char *bases, int min_length);
+void polytail_destroy (polytail *p);
+int polytail_find (const polytail *p, const char *s, int len);
+
+#endif /* POLYTAIL_H */
@@ -1,42 +1,64 @@
 #include <assert.h>
 #include <ctype.h>
 #include <stdlib.h>
+#include <string.h>
 #include <zlib.h>
 #include <stdio.h>
 #include <unistd.h>
 #include "sickle.h"
 #include "kseq.h"
 
+/* Records are formatted into a memory buffer with plain copies; the
+   buffer is handed to an outsink (outsink.h) once a batch is done. */
 
-void print_record (FILE *fp, kseq_t *fqr, cutsites *cs) {
-    fprintf(fp, "@%s", fqr->name.s);
-    if (fqr->comment.l) fprintf(fp, " %s\n", fqr->comment.s);
-    else fprintf(fp, "\n");
-    fprintf(fp, "%.*s\n", cs->three_prime_cut - cs->five_prime_cut, fqr->seq.s + cs->five_prime_cut);
-    fprintf(fp, "+\n");
-    fprintf(fp, "%.*s\n", cs->three_prime_cut - cs->five_prime_cut, fqr->qual.s + cs->five_prime_cut);
+static void kput (kstring_t *s, const char *p, size_t len) {
+    if (s->l + len + 1 > s->m) {
+        s->m = s->l + len + 1;
+        kroundup32(s->m);
+        s->s = (char *) realloc(s->s, s->m);
+    }
+    memcpy(s->s + s->l, p, len);
+    s->l += len;
 }
 
-void print_record_gzip (gzFile fp, kseq_t *fqr, cutsites *cs) {
-    gzprintf(fp, "@%s", fqr->name.s);
-    if (fqr->comment.l) gzprintf(fp, " %s\n", fqr->comment.s);
-    else gzprintf(fp, "\n");
-    gzprintf(fp, "%.*s\n", cs->three_prime_cut - cs->five_prime_cut, fqr->seq.s + cs->five_prime_cut);
-    gzprintf(fp, "+\n");
-    gzprintf(fp, "%.*s\n", cs->three_prime_cut - cs->five_prime_cut, fqr->qual.s + cs->five_prime_cut);
+static void print_header (kstring_t *s, kseq_t *fqr) {
+    kput(s, "@", 1);
+    kput(s, fqr->name.s, fqr->name.l);
+    if (fqr->comment.l) {
+        kput(s, " ", 1);
+        kput(s, fqr->comment.s, fqr->comment.l);
+    }
+    kput(s, "\n", 1);
 }
 
-void print_record_N (FILE *fp, kseq_t *fqr, int qualtype) {
-    fprintf(fp, "@%s", fqr->name.s);
-    if (fqr->comment.l) fprintf(fp, " %s\n", fqr->comment.s);
-    else fprintf(fp, "\n");
-    fprintf(fp, "N\n+\n%c\n", quality_constants[qualtype][Q_MIN]);
+void print_record (kstring_t *s, kseq_t *fqr, cutsites *cs) {
+    print_header(s, fqr);
+    kput(s, fqr->seq.s + cs->five_prime_cut, cs->three_prime_cut - cs->five_prime_cut);
+    kput(s, "\n+\n", 3);
+    kput(s, fqr->qual.s + cs->five_prime_cut, cs->three_prime_cut - cs->five_prime_cut);
+    kput(s, "\n", 1);
 }
 
-void print_record_N_gzip (gzFile fp, kseq_t *fqr, int qualtype) {
-    gzprintf(fp, "@%s", fqr->name.s);
-    if (fqr->comment.l) gzprintf(fp, " %s\n", fqr->comment.s);
-    else gzprintf(fp, "\n");
-    gzprintf(fp, "N\n+\n%c\n", quality_constants[qualtype][Q_MIN]);
+/* Copy a record's input bytes, if they are exactly what print_record()
+   would write for the whole read: a single sequence and quality line,
+   a bare '+' line and a space before the comment. Returns 0, writing
+   nothing, if they are not. */
+int print_record_raw (kstring_t *s, kseq_t *fqr, const char *raw, size_t len) {
+    size_t h = 1 + fqr->name.l + (fqr->comment.l ? 1 + fqr->comment.l : 0) + 1;
+
+    if (len != h + fqr->seq.l + 3 + fqr->qual.l + 1) return 0;
+    if (raw[0] != '@' || raw[h - 1] != '\n' || raw[len - 1] != '\n') return 0;
+    if (fqr->comment.l && raw[1 + fqr->name.l] != ' ') return 0;
+    if (memcmp(raw + h + fqr->seq.l, "\n+\n", 3)) return 0;
+
+    kput(s, raw, len);
+    return 1;
 }
 
+void print_record_N (kstring_t *s, kseq_t *fqr, int qualtype) {
+    char tail[6] = {'N', '\n', '+', '\n', 0, '\n'};
+
+    print_header(s, fqr);
+    tail[4] = quality_constants[qualtype][Q_MIN];
+    kput(s, tail, 6);
+}
@@ -5,9 +5,8 @@
 #include <zlib.h>
 #include "kseq.h"
 
-void print_record (FILE *fp, kseq_t *fqr, cutsites *cs);
-void print_record_gzip (gzFile fp, kseq_t *fqr, cutsites *cs);
-void print_record_N (FILE *fp, kseq_t *fqr, int qualtype);
-void print_record_N_gzip (gzFile fp, kseq_t *fqr, int qualtype);
+void print_record (kstring_t *s, kseq_t *fqr, cutsites *cs);
+int print_record_raw (kstring_t *s, kseq_t *fqr, const char *raw, size_t len);
+void print_record_N (kstring_t *s, kseq_t *fqr, int qualtype);
 
 #endif /* PRINT_RECORD_H */
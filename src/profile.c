@@ -0,0 +1,80 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include "profile.h"
+
+typedef struct {
+    uint64_t ns, records, bytes;
+} profile_counters;
+
+static const char *stage_names[PROF_STAGES] = {"read", "parse", "trim", "format", "write", "compress"};
+
+int profile_on = 0;
+static profile_counters counters[PROF_STAGES];
+static uint64_t profile_t0;
+
+uint64_t profile_clock (void) {
+    struct timespec t;
+
+    clock_gettime (CLOCK_MONOTONIC, &t);
+    return (uint64_t) t.tv_sec * 1000000000u + t.tv_nsec;
+}
+
+/* turn profiling on and start the wall clock */
+void profile_begin (void) {
+    profile_on = 1;
+    profile_t0 = profile_clock ();
+}
+
+void profile_add (profile_stage stage, uint64_t start, uint64_t records, uint64_t bytes) {
+    profile_counters *c = &counters[stage];
+
+    __sync_fetch_and_add (&c->ns, profile_clock () - start);
+    __sync_fetch_and_add (&c->records, records);
+    __sync_fetch_and_add (&c->bytes, bytes);
+}
+
+static double rate (uint64_t n, double s) {
+    return (s > 0) ? n / s : 0;
+}
+
+/* Print the breakdown to stderr, or as JSON to path. */
+void profile_report (const char *path) {
+    double wall = (profile_clock () - profile_t0) / 1e9, s;
+    profile_counters *c;
+    FILE *fp = stderr;
+    int i;
+
+    if (!profile_on) return;
+
+    if (!path) {
+        fprintf (stderr, "\nProfile (%.3f s wall clock):\n", wall);
+        fprintf (stderr, "%-10s %10s %7s %14s %14s %12s %12s\n", "stage", "seconds", "%wall", "records", "bytes", "records/s", "MB/s");
+        for (i = 0; i < PROF_STAGES; i++) {
+            c = &counters[i];
+            s = c->ns / 1e9;
+            fprintf (stderr, "%-10s %10.3f %7.1f %14llu %14llu %12.0f %12.1f\n", stage_names[i], s, wall > 0 ? 100 * s / wall : 0,
+                (unsigned long long) c->records, (unsigned long long) c->bytes, rate (c->records, s), rate (c->bytes, s) / 1e6);
+        }
+        return;
+    }
+
+    fp = fopen (path, "w");
+    if (!fp) {
+        fprintf (stderr, "****Error: Could not open profile file '%s'.\n\n", path);
+        exit (EXIT_FAILURE);
+    }
+    fprintf (fp, "{\n  \"wall_seconds\": %.6f,\n  \"stages\": [\n", wall);
+    for (i = 0; i < PROF_STAGES; i++) {
+        c = &counters[i];
+        s = c->ns / 1e9;
+        fprintf (fp, "    {\"stage\": \"%s\", \"seconds\": %.6f, \"records\": %llu, \"bytes\": %llu, \"records_per_second\": %.1f, \"mb_per_second\": %.3f}%s\n",
+            stage_names[i], s, (unsigned long long) c->records, (unsigned long long) c->bytes, rate (c->records, s), rate (c->bytes, s) / 1e6,
+            i + 1 < PROF_STAGES ? "," : "");
+    }
+    fprintf (fp, "  ]\n}\n");
+    if (fclose (fp) != 0) {
+        fprintf (stderr, "****Error: Could not write profile file '%s'.\n\n", path);
+        exit (EXIT_FAILURE);
+    }
+}
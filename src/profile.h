@@ -0,0 +1,43 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdint.h>
+
+/* Per-stage timers and counters for --profile. Stages are timed a batch
+   or a buffer at a time, never per record, so with profiling off the
+   cost is one branch per batch. Any thread can add to a stage; a
+   stage's time is the sum over the threads that ran it, so stages that
+   run in parallel can add up to more than the wall-clock time.
+
+     read      reading and decompressing the input, into buffers
+     parse     splitting the input into records (includes waiting for
+               the reader when it falls behind)
+     trim      finding the cut sites
+     format    formatting the kept records
+     write     handing the output to the files (includes compression
+               when it does not run on threads of its own)
+     compress  gzip/BGZF compression of the output */
+
+typedef enum {
+  PROF_READ,
+  PROF_PARSE,
+  PROF_TRIM,
+  PROF_FORMAT,
+  PROF_WRITE,
+  PROF_COMPRESS,
+  PROF_STAGES
+} profile_stage;
+
+extern int profile_on;
+
+uint64_t profile_clock (void);
+void profile_begin (void);
+void profile_add (profile_stage stage, uint64_t start, uint64_t records, uint64_t bytes);
+void profile_report (const char *path);
+
+/* start and stop timing a stage; records and bytes are what it handled */
+#define PROFILE_START() (profile_on ? profile_clock () : 0)
+#define PROFILE_STOP(stage, start, records, bytes) \
+  do { if (profile_on) profile_add ((stage), (start), (records), (bytes)); } while (0)
+
+#endif /* PROFILE_H */
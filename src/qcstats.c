@@ -0,0 +1,214 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <zlib.h>
+#include "sickle.h"
+#include "kseq.h"
+#include "qcstats.h"
+
+qcstats *qcstats_init (void) {
+    return (qcstats *) calloc (1, sizeof (qcstats));
+}
+
+void qcstats_destroy (qcstats *qc) {
+    int i;
+
+    if (!qc) return;
+
+    for (i = 0; i < 2; i++) {
+        free (qc->length[i]);
+        free (qc->qual_sum[i]);
+        free (qc->n_count[i]);
+    }
+    free (qc->cut5);
+    free (qc->cut3);
+    free (qc);
+}
+
+/* the arrays hold cap + 1 entries */
+static uint64_t *qc_grow_array (uint64_t *a, int old, int cap) {
+    int have = old ? old + 1 : 0;
+
+    a = (uint64_t *) realloc (a, (cap + 1) * sizeof (uint64_t));
+    memset (a + have, 0, (cap + 1 - have) * sizeof (uint64_t));
+    return a;
+}
+
+/* make room for reads of length len (positions 0 .. len - 1, lengths 0 .. len) */
+static void qc_grow (qcstats *qc, int len) {
+    int cap = qc->cap ? qc->cap : 256, i;
+
+    if (qc->cap && len <= qc->cap) return;
+    while (cap < len) cap *= 2;
+
+    for (i = 0; i < 2; i++) {
+        qc->length[i] = qc_grow_array (qc->length[i], qc->cap, cap);
+        qc->qual_sum[i] = qc_grow_array (qc->qual_sum[i], qc->cap, cap);
+        qc->n_count[i] = qc_grow_array (qc->n_count[i], qc->cap, cap);
+    }
+    qc->cut5 = qc_grow_array (qc->cut5, qc->cap, cap);
+    qc->cut3 = qc_grow_array (qc->cut3, qc->cap, cap);
+    qc->cap = cap;
+}
+
+/* add the bases [from, to) of a read, as positions 0 .. to - from, w times */
+static void qc_add_bases (qcstats *qc, int which, kseq_t *rec, int from, int to, const int *qtab, uint64_t w) {
+    uint64_t *qs = qc->qual_sum[which], *nc = qc->n_count[which];
+    const char *s = rec->seq.s + from;
+    const unsigned char *q = (const unsigned char *) rec->qual.s + from;
+    int len = to - from, i, n = 0, qlen;
+
+    qc->length[which][len] += w;
+    qc->bases[which] += w * len;
+
+    /* reads without a quality for every base only count where they have one */
+    qlen = (int) rec->qual.l - from;
+    if (qlen > len) qlen = len;
+    for (i = 0; i < qlen; i++) qs[i] += w * qtab[q[i]];
+
+    for (i = 0; i < len; i++) {
+        if (s[i] == 'N' || s[i] == 'n') {
+            nc[i] += w;
+            n++;
+        }
+    }
+    qc->n_bases[which] += w * n;
+}
+
+/* w is 1 to add a read, or -1 (wrapping around) to take it back out */
+static void qc_account (qcstats *qc, kseq_t *rec, cutsites *cut, const int *qtab, uint64_t w) {
+    int len = rec->seq.l;
+
+    qc_grow (qc, len);
+    qc->reads += w;
+    qc_add_bases (qc, 0, rec, 0, len, qtab, w);
+
+    if (cut->three_prime_cut < 0) return;
+
+    qc->kept += w;
+    qc_add_bases (qc, 1, rec, cut->five_prime_cut, cut->three_prime_cut, qtab, w);
+    qc->cut5[cut->five_prime_cut] += w;
+    qc->cut3[len - cut->three_prime_cut] += w;
+}
+
+/* Account for one read and its cut sites; qtab maps each quality
+   character to its Phred value (sliding_quality_table()). */
+void qcstats_add (qcstats *qc, kseq_t *rec, cutsites *cut, const int *qtab) {
+    qc_account (qc, rec, cut, qtab, 1);
+}
+
+/* Take back a read that was added, when its batch has to be trimmed
+   again. The counts are unsigned and only read once every thread's
+   statistics are merged, so this may take them below zero for now. */
+void qcstats_remove (qcstats *qc, kseq_t *rec, cutsites *cut, const int *qtab) {
+    qc_account (qc, rec, cut, qtab, (uint64_t) -1);
+}
+
+void qcstats_merge (qcstats *into, qcstats *from) {
+    int i, j;
+
+    qc_grow (into, from->cap);
+    into->reads += from->reads;
+    into->kept += from->kept;
+    for (i = 0; i < 2; i++) {
+        into->bases[i] += from->bases[i];
+        into->n_bases[i] += from->n_bases[i];
+    }
+    if (!from->cap) return;
+
+    for (j = 0; j <= from->cap; j++) {
+        for (i = 0; i < 2; i++) {
+            into->length[i][j] += from->length[i][j];
+            into->qual_sum[i][j] += from->qual_sum[i][j];
+            into->n_count[i][j] += from->n_count[i][j];
+        }
+        into->cut5[j] += from->cut5[j];
+        into->cut3[j] += from->cut3[j];
+    }
+}
+
+/* longest length with a non-zero count, or -1 */
+static int qc_last (const uint64_t *h, int cap) {
+    int i;
+
+    if (!h) return -1;
+    for (i = cap; i >= 0 && h[i] == 0; i--);
+    return i;
+}
+
+/* a histogram as [[value, count], ...], leaving out empty bins */
+static void qc_histogram (FILE *fp, const char *key, const uint64_t *h, int cap) {
+    int i, first = 1, last = qc_last (h, cap);
+
+    fprintf (fp, "      \"%s\": [", key);
+    for (i = 0; i <= last; i++) {
+        if (!h[i]) continue;
+        fprintf (fp, "%s[%d, %" PRIu64 "]", first ? "" : ", ", i, h[i]);
+        first = 0;
+    }
+    fprintf (fp, "]");
+}
+
+/* mean quality and N count at each position; a position's reads are those longer than it */
+static void qc_positions (FILE *fp, qcstats *qc, int which, const char *suffix) {
+    int i, last = qc_last (qc->length[which], qc->cap);
+    uint64_t covered;
+
+    fprintf (fp, "      \"mean_quality_by_position_%s\": [", suffix);
+    for (i = 0, covered = (which == 0) ? qc->reads : qc->kept; i < last; i++) {
+        covered -= qc->length[which][i];
+        fprintf (fp, "%s%.2f", i ? ", " : "", covered ? (double) qc->qual_sum[which][i] / covered : 0.0);
+    }
+    fprintf (fp, "],\n      \"n_by_position_%s\": [", suffix);
+    for (i = 0; i < last; i++) fprintf (fp, "%s%" PRIu64, i ? ", " : "", qc->n_count[which][i]);
+    fprintf (fp, "]");
+}
+
+static void qc_write_read (FILE *fp, const char *name, qcstats *qc) {
+    fprintf (fp, "    \"%s\": {\n", name);
+    fprintf (fp, "      \"reads_before\": %" PRIu64 ",\n      \"reads_after\": %" PRIu64 ",\n", qc->reads, qc->kept);
+    fprintf (fp, "      \"bases_before\": %" PRIu64 ",\n      \"bases_after\": %" PRIu64 ",\n", qc->bases[0], qc->bases[1]);
+    fprintf (fp, "      \"n_bases_before\": %" PRIu64 ",\n      \"n_bases_after\": %" PRIu64 ",\n", qc->n_bases[0], qc->n_bases[1]);
+    qc_histogram (fp, "length_histogram_before", qc->length[0], qc->cap);
+    fprintf (fp, ",\n");
+    qc_histogram (fp, "length_histogram_after", qc->length[1], qc->cap);
+    fprintf (fp, ",\n");
+    qc_positions (fp, qc, 0, "before");
+    fprintf (fp, ",\n");
+    qc_positions (fp, qc, 1, "after");
+    fprintf (fp, ",\n");
+    qc_histogram (fp, "five_prime_cut_histogram", qc->cut5, qc->cap);
+    fprintf (fp, ",\n");
+    qc_histogram (fp, "three_prime_trimmed_histogram", qc->cut3, qc->cap);
+    fprintf (fp, "\n    }");
+}
+
+/* Write the report as JSON: the run's totals, then the statistics of
+   each of the n reads of a fragment (one for se, two for pe). Returns
+   -1, after reporting it, if the file cannot be written, else 0. */
+int qcstats_report (const char *path, const char *mode, uint64_t total, uint64_t kept, uint64_t discarded,
+    qcstats **qc, const char **names, int n) {
+    FILE *fp = fopen (path, "w");
+    int i;
+
+    if (!fp) {
+        fprintf (stderr, "****Error: Could not open QC report file '%s'.\n\n", path);
+        return -1;
+    }
+
+    fprintf (fp, "{\n  \"mode\": \"%s\",\n", mode);
+    fprintf (fp, "  \"total_records\": %" PRIu64 ",\n  \"records_kept\": %" PRIu64 ",\n  \"records_discarded\": %" PRIu64 ",\n", total, kept, discarded);
+    fprintf (fp, "  \"reads\": {\n");
+    for (i = 0; i < n; i++) {
+        qc_write_read (fp, names[i], qc[i]);
+        fprintf (fp, "%s\n", i + 1 < n ? "," : "");
+    }
+    fprintf (fp, "  }\n}\n");
+
+    if (fclose (fp) != 0) {
+        fprintf (stderr, "****Error: Could not write QC report file '%s'.\n\n", path);
+        return -1;
+    }
+    return 0;
+}
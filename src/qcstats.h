@@ -0,0 +1,33 @@
+#ifndef QCSTATS_H
+#define QCSTATS_H
+
+#include <stdint.h>
+#include "sickle.h"
+
+/* QC statistics gathered while trimming, for --qc-report: read length
+   histograms, mean quality and N counts by position, before and after
+   trimming, and histograms of where reads were cut. Each trimming
+   thread fills its own qcstats from the cut sites and qualities it
+   already has, and they are merged once at the end. */
+
+typedef struct __qcstats_ {
+    uint64_t reads, kept;
+    uint64_t bases[2];          /* [0] before trimming, [1] after (kept reads only) */
+    uint64_t n_bases[2];
+    int cap;                    /* positions (and lengths) the arrays below hold */
+    uint64_t *length[2];        /* reads by length */
+    uint64_t *qual_sum[2];      /* sum of the Phred qualities at each position */
+    uint64_t *n_count[2];       /* Ns at each position */
+    uint64_t *cut5;             /* kept reads by 5' cut position */
+    uint64_t *cut3;             /* kept reads by number of bases cut from the 3' end */
+} qcstats;
+
+qcstats *qcstats_init (void);
+void qcstats_destroy (qcstats *qc);
+void qcstats_add (qcstats *qc, kseq_t *rec, cutsites *cut, const int *qtab);
+void qcstats_remove (qcstats *qc, kseq_t *rec, cutsites *cut, const int *qtab);
+void qcstats_merge (qcstats *into, qcstats *from);
+int qcstats_report (const char *path, const char *mode, uint64_t total, uint64_t kept, uint64_t discarded,
+    qcstats **qc, const char **names, int n);
+
+#endif /* QCSTATS_H */
@@ -15,6 +15,8 @@ void main_usage (int status) {
 Command:\n\
 pe\tpaired-end sequence trimming\n\
 se\tsingle-end sequence trimming\n\
+batch\ttrimming of many samples listed in a sample sheet\n\
+index\trecord index of a large input, for trimming it in regions\n\
 \n\
 --help, display this help and exit\n\
 --version, output version information and exit\n\n", PROGRAM_NAME);
@@ -25,7 +27,7 @@ se\tsingle-end sequence trimming\n\
 int main (int argc, char *argv[]) {
 	int retval=0;
 
-	if (argc < 2 || (strcmp (argv[1],"pe") != 0 && strcmp (argv[1],"se") != 0 && strcmp (argv[1],"--version") != 0 && strcmp (argv[1],"--help") != 0)) {
+	if (argc < 2 || (strcmp (argv[1],"pe") != 0 && strcmp (argv[1],"se") != 0 && strcmp (argv[1],"batch") != 0 && strcmp (argv[1],"index") != 0 && strcmp (argv[1],"--version") != 0 && strcmp (argv[1],"--help") != 0)) {
 		main_usage (EXIT_FAILURE);
 	}
 
@@ -50,5 +52,15 @@ int main (int argc, char *argv[]) {
 		return (retval);
 	}
 
+	else if (strcmp (argv[1],"batch") == 0) {
+		retval = batch_main (argc, argv);
+		return (retval);
+	}
+
+	else if (strcmp (argv[1],"index") == 0) {
+		retval = index_main (argc, argv);
+		return (retval);
+	}
+
 	return 0;
 }
@@ -4,6 +4,7 @@
 #include <limits.h>
 #include <zlib.h>
 #include "kseq.h"
+#include "infile.h"
 
 
 /* KSEQ_INIT() cannot be called here, because we only need the types
@@ -11,17 +12,21 @@
    to an unused function warning with GCC. So, the basic typedefs
    kseq.h has are included here, and each file that reads needs:
 
-   __KS_GETC(gzread, BUFFER_SIZE)
-   __KS_GETUNTIL(gzread, BUFFER_SIZE)
+   __KS_GETC(infile_read, BUFFER_SIZE)
+   __KS_GETUNTIL(infile_read, BUFFER_SIZE)
    __KSEQ_READ
 
+   Input goes through infile (infile.h) rather than zlib's gzFile, so
+   that BGZF input can be decompressed on several threads. infile keeps
+   decompressed data in memory ahead of the parser, so BUFFER_SIZE only
+   sets how much the kstream copies at a time.
 */
 
-#define BUFFER_SIZE 4096
-__KS_TYPE(gzFile)
-__KS_BASIC(gzFile, BUFFER_SIZE)
-__KSEQ_TYPE(gzFile)
-__KSEQ_BASIC(gzFile)
+#define BUFFER_SIZE 65536
+__KS_TYPE(infile*)
+__KS_BASIC(infile*, BUFFER_SIZE)
+__KSEQ_TYPE(infile*)
+__KSEQ_BASIC(infile*)
 
 #ifndef PROGRAM_NAME
 #define PROGRAM_NAME "sickle"
@@ -42,6 +47,25 @@ enum {
   GETOPT_HELP_CHAR = (CHAR_MIN - 2),
   GETOPT_VERSION_CHAR = (CHAR_MIN - 3)
 };
+/* values for options that only have a long form */
+enum {
+  BGZF_INDEX_OPTION = CHAR_MAX + 1,
+  READ_BUFFER_OPTION,
+  NO_MMAP_OPTION,
+  TRUSTED_INPUT_OPTION,
+  PROFILE_OPTION,
+  QC_REPORT_OPTION,
+  SHARDS_OPTION,
+  SHARD_BY_OPTION,
+  ADAPTER_OPTION,
+  ADAPTER_MISMATCHES_OPTION,
+  ADAPTER_OVERLAP_OPTION,
+  ADAPTER_ORDER_OPTION,
+  POLY_TAIL_OPTION,
+  POLY_TAIL_LENGTH_OPTION,
+  LANE_ORDER_OPTION,
+  REGION_OPTION
+};
 #define GETOPT_HELP_OPTION_DECL \
 "help", no_argument, NULL, GETOPT_HELP_CHAR
 #define GETOPT_VERSION_OPTION_DECL \
@@ -83,7 +107,7 @@ static const int quality_constants[4][3] = {
   /* offset, min, max */
   {0, 4, 60}, /* PHRED */
   {33, 33, 126}, /* SANGER */
-  {64, 58, 112}, /* SOLEXA; this is an approx; the transform is non-linear */
+  {64, 58, 112}, /* SOLEXA; converted to Phred in sliding.c, the transform is non-linear */
   {64, 64, 110} /* ILLUMINA */
 };
 
@@ -92,10 +116,20 @@ typedef struct __cutsites_ {
 	int three_prime_cut;
 } cutsites;
 
+/* both cut sites of a read with a quality out of range for its type */
+#define SLIDING_BAD_QUALITY -3
+
 
 /* Function Prototypes */
 int single_main (int argc, char *argv[]);
 int paired_main (int argc, char *argv[]);
-cutsites* sliding_window (kseq_t *fqrec, int qualtype, int length_threshold, int qual_threshold, int no_fiveprime, int trunc_n, int debug);
+int batch_main (int argc, char *argv[]);
+int index_main (int argc, char *argv[]);
+cutsites sliding_window (kseq_t *fqrec, int qualtype, int length_threshold, int qual_threshold, int no_fiveprime, int trunc_n, int trusted, int debug);
+/* trims a whole batch; specialized for a quality type and flag combination.
+   Returns -1 if a read has a quality out of range (reported on stderr). */
+typedef int (*sliding_batch_fn) (kseq_t *recs, int n, cutsites *cut, int length_threshold, int qual_threshold);
+sliding_batch_fn sliding_select_batch (int qualtype, int no_fiveprime, int trunc_n, int trusted);
+const int *sliding_quality_table (int qualtype);
 
 #endif /*SICKLE_H*/
@@ -4,61 +4,101 @@
 #include <zlib.h>
 #include <stdio.h>
 #include <getopt.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
 #include "sickle.h"
 #include "kseq.h"
+#include "sliding_simd.h"
 
-int get_quality_num (char qualchar, int qualtype, kseq_t *fqrec, int pos) {
-  /* 
-     Return the adjusted quality, depending on quality type.
+/* The helpers of the window search are forced inline, so that each
+   specialized batch variant below gets its own copy with the quality
+   type and the flags as constants (and no debug output at all). */
+#if defined(__GNUC__)
+#define SLIDING_INLINE static inline __attribute__((always_inline))
+#define SLIDING_COLD static __attribute__((cold, noinline))
+#else
+#define SLIDING_INLINE static inline
+#define SLIDING_COLD static
+#endif
 
-     Note that this uses the array in sickle.h, which *approximates*
-     the SOLEXA (pre-1.3 pipeline) qualities as linear. This is
-     inaccurate with low-quality bases.
-  */
+/* longest read whose SOLEXA qualities are converted for the vector kernel */
+#define SLIDING_MAP_MAX 4096
 
-  int qual_value = (int) qualchar;
+/* decoded quality of every character, for each quality type */
+static int quality_lut[4][256];
+
+static sliding_kernel kernel;
+static sliding_range range;
+static pthread_once_t kernel_once = PTHREAD_ONCE_INIT;
+
+static void sliding_init (void) {
+	int qt, c, q;
+
+	kernel = sliding_select_kernel ();
+	range = sliding_select_range ();
+
+	for (qt = 0; qt < 4; qt++) {
+		for (c = 0; c < 256; c++) {
+			q = (signed char) c - quality_constants[qt][Q_OFFSET];
+			/* SOLEXA scores are log-odds: Q(phred) = 10 log10(10^(Q(solexa)/10) + 1) */
+			if (qt == SOLEXA) q = (int) floor (10.0 * log10 (pow (10.0, q / 10.0) + 1.0) + 0.5);
+			quality_lut[qt][c] = q;
+		}
+	}
+}
+
+SLIDING_COLD void quality_error (char qualchar, int qualtype, kseq_t *fqrec, int pos) {
+	int qual_value = (int) qualchar;
 
-  if (qual_value < quality_constants[qualtype][Q_MIN] || qual_value > quality_constants[qualtype][Q_MAX]) {
 	fprintf (stderr, "ERROR: Quality value (%d) does not fall within correct range for %s encoding.\n", qual_value, typenames[qualtype]);
 	fprintf (stderr, "Range for %s encoding: %d-%d\n", typenames[qualtype], quality_constants[qualtype][Q_MIN], quality_constants[qualtype][Q_MAX]);
 	fprintf (stderr, "FastQ record: %s\n", fqrec->name.s);
 	fprintf (stderr, "Quality string: %s\n", fqrec->qual.s);
 	fprintf (stderr, "Quality char: '%c'\n", qualchar);
 	fprintf (stderr, "Quality position: %d\n", pos+1);
-	exit(1);
+}
+
+SLIDING_INLINE int get_quality_num (char qualchar, int qualtype, int trusted, kseq_t *fqrec, int pos, int *bad) {
+  /* 
+     Return the adjusted quality, depending on quality type.
+
+     The value comes from a table built once per quality type, which
+     also converts SOLEXA (pre-1.3 pipeline) qualities to the Phred
+     scale exactly rather than treating them as linear. The range check
+     is skipped for trusted input (--trusted-input); the first value
+     out of range in a read is reported, and sets *bad.
+  */
+
+  int qual_value = (int) qualchar;
+
+  if (!trusted && !*bad && (qual_value < quality_constants[qualtype][Q_MIN] || qual_value > quality_constants[qualtype][Q_MAX])) {
+	quality_error (qualchar, qualtype, fqrec, pos);
+	*bad = 1;
   }
 
-  return (qual_value - quality_constants[qualtype][Q_OFFSET]);
+  return quality_lut[qualtype][(unsigned char) qualchar];
 }
 
 
-cutsites* sliding_window (kseq_t *fqrec, int qualtype, int length_threshold, int qual_threshold, int no_fiveprime, int trunc_n, int debug) {
+/* The original window search, one base at a time. Used when no vector
+   kernel is available, for debug output, and for reads the kernels do
+   not take (bad quality characters, quality and sequence lengths that
+   differ); returns whether a 5' cut was found, or -1 if a quality was
+   out of range. */
+SLIDING_INLINE int sliding_scalar (kseq_t *fqrec, int qualtype, int trusted, int window_size, int qual_threshold, int no_fiveprime, int debug, int *five_cut, int *three_cut) {
 
-	int window_size = (int) (0.1 * fqrec->seq.l);
 	int i,j;
 	int window_start=0;
 	int window_total=0;
 	int three_prime_cut = fqrec->seq.l;
 	int five_prime_cut = 0;
 	int found_five_prime = 0;
+	int bad = 0;
 	double window_avg;
-	cutsites* retvals;
-    char *npos;
-
-	/* discard if the length of the sequence is less than the length threshold */
-    if (fqrec->seq.l < length_threshold) {
-		retvals = (cutsites*) malloc (sizeof(cutsites));
-		retvals->three_prime_cut = -1;
-		retvals->five_prime_cut = -1;
-		return (retvals);
-	}
-
-	/* if the seq length is less then 10bp, */
-	/* then make the window size the length of the seq */
-	if (window_size == 0) window_size = fqrec->seq.l;
 
 	for (i=0; i<window_size; i++) {
-		window_total += get_quality_num (fqrec->qual.s[i], qualtype, fqrec, i);
+		window_total += get_quality_num (fqrec->qual.s[i], qualtype, trusted, fqrec, i, &bad);
 	}
 
 	for (i=0; i <= fqrec->qual.l - window_size; i++) {
@@ -75,7 +115,7 @@ cutsites* sliding_window (kseq_t *fqrec, int qualtype, int length_threshold, int
 
 			/* at what point in the window does the quality go above the threshold? */
 			for (j=window_start; j<window_start+window_size; j++) {
-				if (get_quality_num (fqrec->qual.s[j], qualtype, fqrec, j) >= qual_threshold) {
+				if (get_quality_num (fqrec->qual.s[j], qualtype, trusted, fqrec, j, &bad) >= qual_threshold) {
 					five_prime_cut = j;
 					break;
 				}
@@ -94,7 +134,7 @@ cutsites* sliding_window (kseq_t *fqrec, int qualtype, int length_threshold, int
 
 			/* at what point in the window does the quality dip below the threshold? */
 			for (j=window_start; j<window_start+window_size; j++) {
-				if (get_quality_num (fqrec->qual.s[j], qualtype, fqrec, j) < qual_threshold) {
+				if (get_quality_num (fqrec->qual.s[j], qualtype, trusted, fqrec, j, &bad) < qual_threshold) {
 					three_prime_cut = j;
 					break;
 				}
@@ -104,13 +144,103 @@ cutsites* sliding_window (kseq_t *fqrec, int qualtype, int length_threshold, int
 		}
 
 		/* instead of sliding the window, subtract the first qual and add the next qual */
-		window_total -= get_quality_num (fqrec->qual.s[window_start], qualtype, fqrec, window_start);
+		window_total -= get_quality_num (fqrec->qual.s[window_start], qualtype, trusted, fqrec, window_start, &bad);
 		if (window_start+window_size < fqrec->qual.l) {
-			window_total += get_quality_num (fqrec->qual.s[window_start+window_size], qualtype, fqrec, window_start+window_size);
+			window_total += get_quality_num (fqrec->qual.s[window_start+window_size], qualtype, trusted, fqrec, window_start+window_size, &bad);
 		}
 		window_start++;
 	}
 
+	*five_cut = five_prime_cut;
+	*three_cut = three_prime_cut;
+	return bad ? -1 : found_five_prime;
+}
+
+/* Convert a read's SOLEXA qualities to Phred+33 characters, so that the
+   vector kernel (which works on linear encodings) can take them. Returns
+   0 if a character is out of range; the scalar code then reports it. */
+SLIDING_INLINE int sliding_map (kseq_t *fqrec, int qualtype, int trusted, char *out) {
+	int lo = quality_constants[qualtype][Q_MIN];
+	int hi = quality_constants[qualtype][Q_MAX];
+	int i, c;
+
+	for (i = 0; i < fqrec->qual.l; i++) {
+		c = fqrec->qual.s[i];
+		if (!trusted && (c < lo || c > hi)) return 0;
+		out[i] = (char) (33 + quality_lut[qualtype][(unsigned char) c]);
+	}
+	return 1;
+}
+
+/* Whether every base of a read is at or above the quality threshold and
+   it is long enough, with no N to truncate at, in which case the window
+   search would keep it whole (cut at 0 and seq.l). Reads with a quality
+   out of range never pass, so that the search runs and reports them. */
+SLIDING_INLINE int sliding_pass (kseq_t *fqrec, int qualtype, int trusted, int length_threshold, int qual_threshold, int trunc_n) {
+	int lo, hi, i;
+
+	if (fqrec->seq.l == 0 || fqrec->seq.l < length_threshold || fqrec->qual.l != fqrec->seq.l) return 0;
+	if (trunc_n && (strchr (fqrec->seq.s, 'N') || strchr (fqrec->seq.s, 'n'))) return 0;
+
+	if (range) {
+		range (fqrec->qual.s, fqrec->qual.l, &lo, &hi);
+	} else {
+		lo = CHAR_MAX;
+		hi = CHAR_MIN;
+		for (i = 0; i < fqrec->qual.l; i++) {
+			if (fqrec->qual.s[i] < lo) lo = fqrec->qual.s[i];
+			if (fqrec->qual.s[i] > hi) hi = fqrec->qual.s[i];
+		}
+	}
+
+	if (!trusted && (lo < quality_constants[qualtype][Q_MIN] || hi > quality_constants[qualtype][Q_MAX])) return 0;
+
+	/* the decoding tables are monotonic, so the lowest character has the lowest quality */
+	return quality_lut[qualtype][(unsigned char) lo] >= qual_threshold;
+}
+
+/* The window search itself, for reads that may need trimming. */
+SLIDING_INLINE cutsites sliding_search (kseq_t *fqrec, int qualtype, int trusted, int length_threshold, int qual_threshold, int no_fiveprime, int trunc_n, int debug) {
+
+	int window_size = (int) (0.1 * fqrec->seq.l);
+	int three_prime_cut = fqrec->seq.l;
+	int five_prime_cut = 0;
+	int found_five_prime = -1;
+	cutsites retvals;
+    char *npos;
+	char mapped[SLIDING_MAP_MAX];
+
+	/* discard if the length of the sequence is less than the length threshold */
+    if (fqrec->seq.l < length_threshold) {
+		retvals.three_prime_cut = -1;
+		retvals.five_prime_cut = -1;
+		return (retvals);
+	}
+
+	/* if the seq length is less then 10bp, */
+	/* then make the window size the length of the seq */
+	if (window_size == 0) window_size = fqrec->seq.l;
+
+	/* use the vector kernel for the window search when the CPU has one */
+	if (kernel && !debug && fqrec->seq.l > 0 && fqrec->qual.l == fqrec->seq.l) {
+		if (qualtype != SOLEXA) {
+			found_five_prime = kernel (fqrec->qual.s, fqrec->seq.l, window_size, quality_constants[qualtype][Q_OFFSET],
+				quality_constants[qualtype][Q_MIN], quality_constants[qualtype][Q_MAX], !trusted, qual_threshold,
+				no_fiveprime, &five_prime_cut, &three_prime_cut);
+		} else if (fqrec->seq.l <= SLIDING_MAP_MAX && sliding_map (fqrec, qualtype, trusted, mapped)) {
+			found_five_prime = kernel (mapped, fqrec->seq.l, window_size, 33, 0, 127, 0, qual_threshold,
+				no_fiveprime, &five_prime_cut, &three_prime_cut);
+		}
+	}
+
+	if (found_five_prime < 0) {
+		found_five_prime = sliding_scalar (fqrec, qualtype, trusted, window_size, qual_threshold, no_fiveprime, debug, &five_prime_cut, &three_prime_cut);
+		if (found_five_prime < 0) {
+			retvals.three_prime_cut = SLIDING_BAD_QUALITY;
+			retvals.five_prime_cut = SLIDING_BAD_QUALITY;
+			return (retvals);
+		}
+	}
 
     /* If truncate N option is selected, and sequence has Ns, then */
     /* change 3' cut site to be the base before the first N */
@@ -130,8 +260,81 @@ cutsites* sliding_window (kseq_t *fqrec, int qualtype, int length_threshold, int
 
     if (debug) printf ("\n\n");
 
-	retvals = (cutsites*) malloc (sizeof(cutsites));
-	retvals->three_prime_cut = three_prime_cut;
-	retvals->five_prime_cut = five_prime_cut;
+	retvals.three_prime_cut = three_prime_cut;
+	retvals.five_prime_cut = five_prime_cut;
 	return (retvals);
 }
+
+/* The cut sites are returned by value, so trimming a read does not allocate. */
+cutsites sliding_window (kseq_t *fqrec, int qualtype, int length_threshold, int qual_threshold, int no_fiveprime, int trunc_n, int trusted, int debug) {
+	cutsites retvals;
+
+	pthread_once (&kernel_once, sliding_init);
+
+	/* most reads of a good run need no trimming at all */
+	if (!debug && sliding_pass (fqrec, qualtype, trusted, length_threshold, qual_threshold, trunc_n)) {
+		retvals.five_prime_cut = 0;
+		retvals.three_prime_cut = fqrec->seq.l;
+		return (retvals);
+	}
+
+	return sliding_search (fqrec, qualtype, trusted, length_threshold, qual_threshold, no_fiveprime, trunc_n, debug);
+}
+
+/* Find the cut sites of the n records of a batch, as sliding_window()
+   does without debug output. A first sweep over all the qualities keeps
+   the reads that need no trimming, and only the rest are searched.
+   Returns -1 at the first read with a quality out of range, else 0. */
+SLIDING_INLINE int sliding_batch (kseq_t *recs, int n, cutsites *cut, int qualtype, int length_threshold, int qual_threshold, int no_fiveprime, int trunc_n, int trusted) {
+	int i;
+
+	for (i = 0; i < n; i++) {
+		cut[i].five_prime_cut = 0;
+		cut[i].three_prime_cut = sliding_pass (&recs[i], qualtype, trusted, length_threshold, qual_threshold, trunc_n) ? recs[i].seq.l : -2;
+	}
+
+	for (i = 0; i < n; i++) {
+		if (cut[i].three_prime_cut == -2) {
+			cut[i] = sliding_search (&recs[i], qualtype, trusted, length_threshold, qual_threshold, no_fiveprime, trunc_n, 0);
+			if (cut[i].three_prime_cut == SLIDING_BAD_QUALITY) return -1;
+		}
+	}
+	return 0;
+}
+
+/* One batch variant per quality type, 5' trimming on or off, N
+   truncation on or off and the range check on or off (trusted input);
+   sliding_select_batch() picks one at startup. */
+#define SLIDING_VARIANT(qt, no5, tn, tr) \
+static int sliding_batch_##qt##_##no5##_##tn##_##tr (kseq_t *recs, int n, cutsites *cut, int length_threshold, int qual_threshold) { \
+	return sliding_batch (recs, n, cut, qt, length_threshold, qual_threshold, no5, tn, tr); \
+}
+#define SLIDING_VARIANTS(qt) \
+	SLIDING_VARIANT (qt, 0, 0, 0) SLIDING_VARIANT (qt, 0, 0, 1) SLIDING_VARIANT (qt, 0, 1, 0) SLIDING_VARIANT (qt, 0, 1, 1) \
+	SLIDING_VARIANT (qt, 1, 0, 0) SLIDING_VARIANT (qt, 1, 0, 1) SLIDING_VARIANT (qt, 1, 1, 0) SLIDING_VARIANT (qt, 1, 1, 1)
+#define SLIDING_VARIANT_TABLE(qt) \
+	{{{sliding_batch_##qt##_0_0_0, sliding_batch_##qt##_0_0_1}, {sliding_batch_##qt##_0_1_0, sliding_batch_##qt##_0_1_1}}, \
+	 {{sliding_batch_##qt##_1_0_0, sliding_batch_##qt##_1_0_1}, {sliding_batch_##qt##_1_1_0, sliding_batch_##qt##_1_1_1}}}
+
+SLIDING_VARIANTS (PHRED)
+SLIDING_VARIANTS (SANGER)
+SLIDING_VARIANTS (SOLEXA)
+SLIDING_VARIANTS (ILLUMINA)
+
+static const sliding_batch_fn sliding_variants[4][2][2][2] = {
+	SLIDING_VARIANT_TABLE (PHRED),
+	SLIDING_VARIANT_TABLE (SANGER),
+	SLIDING_VARIANT_TABLE (SOLEXA),
+	SLIDING_VARIANT_TABLE (ILLUMINA)
+};
+
+sliding_batch_fn sliding_select_batch (int qualtype, int no_fiveprime, int trunc_n, int trusted) {
+	pthread_once (&kernel_once, sliding_init);
+	return sliding_variants[qualtype][no_fiveprime != 0][trunc_n != 0][trusted != 0];
+}
+
+/* The Phred value of every quality character, for the QC report. */
+const int *sliding_quality_table (int qualtype) {
+	pthread_once (&kernel_once, sliding_init);
+	return quality_lut[qualtype];
+}
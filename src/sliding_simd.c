@@ -0,0 +1,449 @@
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include "sliding_simd.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+
+#include <immintrin.h>
+
+#define SLIDING_SIMD 1
+
+static int load4 (const char *p) {
+    int v;
+
+    memcpy (&v, p, 4);
+    return v;
+}
+
+/* Every kernel is the same search over windows; only the helpers that
+   validate, sum and scan the quality string differ per instruction set:
+
+     isa_valid (q, len, qmin, qmax)   all of q within [qmin, qmax]?
+     isa_sum (q, n)                   sum of the first n characters
+     isa_find (q, len, ws, w, &d, k, lt)
+                                      the first window from w on whose total
+                                      is >= k (or < k if lt), given d, the
+                                      total of window w; updates d
+     isa_scan (p, n, c, lt)           the first of n characters >= c (or < c) */
+#define SLIDING_KERNEL(isa, tgt)                                        \
+__attribute__((target (tgt)))                                           \
+static int sliding_##isa (const char *qual, int len, int ws, int offset, int qmin, int qmax, int validate, int qual_threshold, int no_fiveprime, int *five_prime_cut, int *three_prime_cut) \
+{                                                                       \
+    int nw = len - ws + 1;      /* windows start at 0 .. len - ws */     \
+    long long kk = (long long) qual_threshold * ws;                     \
+    int k = (kk > INT_MAX) ? INT_MAX : (int) kk;                        \
+    int c = qual_threshold + offset;                                    \
+    int found = 0, w = 0, d, j;                                         \
+                                                                        \
+    if (validate && !isa##_valid (qual, len, qmin, qmax)) return -1;    \
+                                                                        \
+    *five_prime_cut = 0;                                                \
+    *three_prime_cut = len;                                             \
+    d = isa##_sum (qual, ws) - ws * offset;                             \
+                                                                        \
+    if (!no_fiveprime) {                                                \
+        w = isa##_find (qual, len, ws, 0, &d, k, 0);                    \
+        if (w == nw) return 0;                                          \
+        j = isa##_scan (qual + w, ws, c, 0);                            \
+        if (j < ws) *five_prime_cut = w + j;                            \
+        found = 1;                                                      \
+                                                                        \
+        /* the 3' search starts with the next window */                 \
+        if (w + 1 == nw) return found;                                  \
+        d += qual[w + ws] - qual[w];                                    \
+        w++;                                                            \
+    }                                                                   \
+                                                                        \
+    w = isa##_find (qual, len, ws, w, &d, k, 1);                        \
+    if (w < nw) {                                                       \
+        j = isa##_scan (qual + w, ws, c, 1);                            \
+        if (j < ws) *three_prime_cut = w + j;                           \
+    }                                                                   \
+                                                                        \
+    return found;                                                       \
+}
+
+/* scalar tail of the window search, shared by all kernels */
+static int sliding_find_tail (const char *q, int len, int ws, int w, int *d, int k, int lt) {
+    int nw = len - ws + 1;
+    int t = *d;
+
+    while (w + 1 < nw) {
+        t += q[w + ws] - q[w];
+        w++;
+        if (lt ? t < k : t >= k) {
+            *d = t;
+            return w;
+        }
+    }
+
+    *d = t;
+    return nw;
+}
+
+/* thresholds outside the valid character range match everything or nothing */
+static int sliding_scan_clamp (int n, int c, int lt) {
+    if (c <= 0) return lt ? n : 0;
+    return lt ? 0 : n;
+}
+
+/* SSE4.2: four windows at a time */
+
+__attribute__((target ("sse4.2")))
+static int sse42_valid (const char *q, int len, int qmin, int qmax) {
+    __m128i vmin = _mm_set1_epi8 ((char) qmin);
+    __m128i vmax = _mm_set1_epi8 ((char) qmax);
+    __m128i bad = _mm_setzero_si128 ();
+    __m128i x;
+    int i;
+
+    for (i = 0; i + 16 <= len; i += 16) {
+        x = _mm_loadu_si128 ((const __m128i *) (q + i));
+        bad = _mm_or_si128 (bad, _mm_or_si128 (_mm_cmpgt_epi8 (vmin, x), _mm_cmpgt_epi8 (x, vmax)));
+    }
+    if (!_mm_testz_si128 (bad, bad)) return 0;
+
+    for (; i < len; i++) {
+        if (q[i] < qmin || q[i] > qmax) return 0;
+    }
+    return 1;
+}
+
+__attribute__((target ("sse4.2")))
+static int sse42_sum (const char *q, int n) {
+    __m128i acc = _mm_setzero_si128 ();
+    int i, sum;
+
+    for (i = 0; i + 16 <= n; i += 16) {
+        acc = _mm_add_epi64 (acc, _mm_sad_epu8 (_mm_loadu_si128 ((const __m128i *) (q + i)), _mm_setzero_si128 ()));
+    }
+    sum = _mm_cvtsi128_si32 (acc) + _mm_extract_epi32 (acc, 2);
+    for (; i < n; i++) sum += q[i];
+    return sum;
+}
+
+__attribute__((target ("sse4.2")))
+static int sse42_find (const char *q, int len, int ws, int w, int *d, int k, int lt) {
+    __m128i vk = _mm_set1_epi32 (lt ? k : k - 1);
+    __m128i a, b, x;
+    int m, t[4];
+
+    if (lt ? *d < k : *d >= k) return w;
+
+    /* windows w+1 .. w+4 from the prefix sums of (entering - leaving) */
+    while (w + 4 + ws <= len) {
+        a = _mm_cvtepu8_epi32 (_mm_cvtsi32_si128 (load4 (q + w)));
+        b = _mm_cvtepu8_epi32 (_mm_cvtsi32_si128 (load4 (q + w + ws)));
+        x = _mm_sub_epi32 (b, a);
+        x = _mm_add_epi32 (x, _mm_slli_si128 (x, 4));
+        x = _mm_add_epi32 (x, _mm_slli_si128 (x, 8));
+        x = _mm_add_epi32 (x, _mm_set1_epi32 (*d));
+
+        m = _mm_movemask_ps (_mm_castsi128_ps (lt ? _mm_cmpgt_epi32 (vk, x) : _mm_cmpgt_epi32 (x, vk)));
+        if (m) {
+            _mm_storeu_si128 ((__m128i *) t, x);
+            *d = t[__builtin_ctz (m)];
+            return w + 1 + __builtin_ctz (m);
+        }
+        *d = _mm_extract_epi32 (x, 3);
+        w += 4;
+    }
+
+    return sliding_find_tail (q, len, ws, w, d, k, lt);
+}
+
+__attribute__((target ("sse4.2")))
+static int sse42_scan (const char *p, int n, int c, int lt) {
+    __m128i vc;
+    int i, m;
+
+    if (c <= 0 || c > 127) return sliding_scan_clamp (n, c, lt);
+    vc = _mm_set1_epi8 ((char) (lt ? c : c - 1));
+
+    for (i = 0; i + 16 <= n; i += 16) {
+        __m128i x = _mm_loadu_si128 ((const __m128i *) (p + i));
+        m = _mm_movemask_epi8 (lt ? _mm_cmpgt_epi8 (vc, x) : _mm_cmpgt_epi8 (x, vc));
+        if (m) return i + __builtin_ctz (m);
+    }
+    for (; i < n; i++) {
+        if (lt ? p[i] < c : p[i] >= c) return i;
+    }
+    return n;
+}
+
+SLIDING_KERNEL (sse42, "sse4.2")
+
+/* horizontal min and max of the sixteen signed bytes in lo and hi */
+__attribute__((target ("sse4.2")))
+static void sse42_reduce (__m128i lo, __m128i hi, int *qlo, int *qhi) {
+    lo = _mm_min_epi8 (lo, _mm_srli_si128 (lo, 8));
+    lo = _mm_min_epi8 (lo, _mm_srli_si128 (lo, 4));
+    lo = _mm_min_epi8 (lo, _mm_srli_si128 (lo, 2));
+    lo = _mm_min_epi8 (lo, _mm_srli_si128 (lo, 1));
+    hi = _mm_max_epi8 (hi, _mm_srli_si128 (hi, 8));
+    hi = _mm_max_epi8 (hi, _mm_srli_si128 (hi, 4));
+    hi = _mm_max_epi8 (hi, _mm_srli_si128 (hi, 2));
+    hi = _mm_max_epi8 (hi, _mm_srli_si128 (hi, 1));
+    *qlo = (signed char) _mm_cvtsi128_si32 (lo);
+    *qhi = (signed char) _mm_cvtsi128_si32 (hi);
+}
+
+/* min and max of the characters left over after the vector loop */
+static void sliding_range_tail (const char *q, int i, int len, int *lo, int *hi) {
+    for (; i < len; i++) {
+        if (q[i] < *lo) *lo = q[i];
+        if (q[i] > *hi) *hi = q[i];
+    }
+}
+
+__attribute__((target ("sse4.2")))
+static void sliding_range_sse42 (const char *q, int len, int *qlo, int *qhi) {
+    __m128i lo = _mm_set1_epi8 (CHAR_MAX), hi = _mm_set1_epi8 (CHAR_MIN);
+    __m128i x;
+    int i;
+
+    for (i = 0; i + 16 <= len; i += 16) {
+        x = _mm_loadu_si128 ((const __m128i *) (q + i));
+        lo = _mm_min_epi8 (lo, x);
+        hi = _mm_max_epi8 (hi, x);
+    }
+    sse42_reduce (lo, hi, qlo, qhi);
+    sliding_range_tail (q, i, len, qlo, qhi);
+}
+
+/* AVX2: eight windows at a time */
+
+__attribute__((target ("avx2")))
+static int avx2_valid (const char *q, int len, int qmin, int qmax) {
+    __m256i vmin = _mm256_set1_epi8 ((char) qmin);
+    __m256i vmax = _mm256_set1_epi8 ((char) qmax);
+    __m256i bad = _mm256_setzero_si256 ();
+    __m256i x;
+    int i;
+
+    for (i = 0; i + 32 <= len; i += 32) {
+        x = _mm256_loadu_si256 ((const __m256i *) (q + i));
+        bad = _mm256_or_si256 (bad, _mm256_or_si256 (_mm256_cmpgt_epi8 (vmin, x), _mm256_cmpgt_epi8 (x, vmax)));
+    }
+    if (!_mm256_testz_si256 (bad, bad)) return 0;
+
+    for (; i < len; i++) {
+        if (q[i] < qmin || q[i] > qmax) return 0;
+    }
+    return 1;
+}
+
+__attribute__((target ("avx2")))
+static int avx2_sum (const char *q, int n) {
+    __m256i acc = _mm256_setzero_si256 ();
+    __m128i s;
+    int i, sum;
+
+    for (i = 0; i + 32 <= n; i += 32) {
+        acc = _mm256_add_epi64 (acc, _mm256_sad_epu8 (_mm256_loadu_si256 ((const __m256i *) (q + i)), _mm256_setzero_si256 ()));
+    }
+    s = _mm_add_epi64 (_mm256_castsi256_si128 (acc), _mm256_extracti128_si256 (acc, 1));
+    sum = _mm_cvtsi128_si32 (s) + _mm_extract_epi32 (s, 2);
+    for (; i < n; i++) sum += q[i];
+    return sum;
+}
+
+__attribute__((target ("avx2")))
+static int avx2_find (const char *q, int len, int ws, int w, int *d, int k, int lt) {
+    __m256i vk = _mm256_set1_epi32 (lt ? k : k - 1);
+    __m256i a, b, x, carry;
+    int m, t[8];
+
+    if (lt ? *d < k : *d >= k) return w;
+
+    while (w + 8 + ws <= len) {
+        a = _mm256_cvtepu8_epi32 (_mm_loadl_epi64 ((const __m128i *) (q + w)));
+        b = _mm256_cvtepu8_epi32 (_mm_loadl_epi64 ((const __m128i *) (q + w + ws)));
+        x = _mm256_sub_epi32 (b, a);
+
+        /* prefix sums within each 128-bit lane, then carry the low lane's total up */
+        x = _mm256_add_epi32 (x, _mm256_slli_si256 (x, 4));
+        x = _mm256_add_epi32 (x, _mm256_slli_si256 (x, 8));
+        carry = _mm256_permutevar8x32_epi32 (x, _mm256_set1_epi32 (3));
+        x = _mm256_add_epi32 (x, _mm256_blend_epi32 (_mm256_setzero_si256 (), carry, 0xf0));
+        x = _mm256_add_epi32 (x, _mm256_set1_epi32 (*d));
+
+        m = _mm256_movemask_ps (_mm256_castsi256_ps (lt ? _mm256_cmpgt_epi32 (vk, x) : _mm256_cmpgt_epi32 (x, vk)));
+        _mm256_storeu_si256 ((__m256i *) t, x);
+        if (m) {
+            *d = t[__builtin_ctz (m)];
+            return w + 1 + __builtin_ctz (m);
+        }
+        *d = t[7];
+        w += 8;
+    }
+
+    return sliding_find_tail (q, len, ws, w, d, k, lt);
+}
+
+__attribute__((target ("avx2")))
+static int avx2_scan (const char *p, int n, int c, int lt) {
+    __m256i vc;
+    int i;
+    unsigned int m;
+
+    if (c <= 0 || c > 127) return sliding_scan_clamp (n, c, lt);
+    vc = _mm256_set1_epi8 ((char) (lt ? c : c - 1));
+
+    for (i = 0; i + 32 <= n; i += 32) {
+        __m256i x = _mm256_loadu_si256 ((const __m256i *) (p + i));
+        m = (unsigned int) _mm256_movemask_epi8 (lt ? _mm256_cmpgt_epi8 (vc, x) : _mm256_cmpgt_epi8 (x, vc));
+        if (m) return i + __builtin_ctz (m);
+    }
+    for (; i < n; i++) {
+        if (lt ? p[i] < c : p[i] >= c) return i;
+    }
+    return n;
+}
+
+SLIDING_KERNEL (avx2, "avx2")
+
+__attribute__((target ("avx2")))
+static void sliding_range_avx2 (const char *q, int len, int *qlo, int *qhi) {
+    __m256i lo = _mm256_set1_epi8 (CHAR_MAX), hi = _mm256_set1_epi8 (CHAR_MIN);
+    __m256i x;
+    int i;
+
+    for (i = 0; i + 32 <= len; i += 32) {
+        x = _mm256_loadu_si256 ((const __m256i *) (q + i));
+        lo = _mm256_min_epi8 (lo, x);
+        hi = _mm256_max_epi8 (hi, x);
+    }
+    sse42_reduce (_mm_min_epi8 (_mm256_castsi256_si128 (lo), _mm256_extracti128_si256 (lo, 1)),
+        _mm_max_epi8 (_mm256_castsi256_si128 (hi), _mm256_extracti128_si256 (hi, 1)), qlo, qhi);
+    sliding_range_tail (q, i, len, qlo, qhi);
+}
+
+/* AVX-512: sixteen windows at a time */
+
+__attribute__((target ("avx512f,avx512bw")))
+static int avx512_valid (const char *q, int len, int qmin, int qmax) {
+    __m512i vmin = _mm512_set1_epi8 ((char) qmin);
+    __m512i vmax = _mm512_set1_epi8 ((char) qmax);
+    __m512i x;
+    int i;
+
+    for (i = 0; i + 64 <= len; i += 64) {
+        x = _mm512_loadu_si512 ((const void *) (q + i));
+        if (_mm512_cmpgt_epi8_mask (vmin, x) | _mm512_cmpgt_epi8_mask (x, vmax)) return 0;
+    }
+
+    for (; i < len; i++) {
+        if (q[i] < qmin || q[i] > qmax) return 0;
+    }
+    return 1;
+}
+
+__attribute__((target ("avx512f,avx512bw")))
+static int avx512_sum (const char *q, int n) {
+    __m512i acc = _mm512_setzero_si512 ();
+    int i, sum;
+
+    for (i = 0; i + 64 <= n; i += 64) {
+        acc = _mm512_add_epi64 (acc, _mm512_sad_epu8 (_mm512_loadu_si512 ((const void *) (q + i)), _mm512_setzero_si512 ()));
+    }
+    sum = (int) _mm512_reduce_add_epi64 (acc);
+    for (; i < n; i++) sum += q[i];
+    return sum;
+}
+
+__attribute__((target ("avx512f,avx512bw")))
+static int avx512_find (const char *q, int len, int ws, int w, int *d, int k, int lt) {
+    __m512i vk = _mm512_set1_epi32 (k);
+    __m512i zero = _mm512_setzero_si512 ();
+    __m512i a, b, x;
+    __mmask16 m;
+    int t[16];
+
+    if (lt ? *d < k : *d >= k) return w;
+
+    while (w + 16 + ws <= len) {
+        a = _mm512_cvtepu8_epi32 (_mm_loadu_si128 ((const __m128i *) (q + w)));
+        b = _mm512_cvtepu8_epi32 (_mm_loadu_si128 ((const __m128i *) (q + w + ws)));
+        x = _mm512_sub_epi32 (b, a);
+
+        /* prefix sums: add the vector shifted up by 1, 2, 4 and 8 elements */
+        x = _mm512_add_epi32 (x, _mm512_alignr_epi32 (x, zero, 15));
+        x = _mm512_add_epi32 (x, _mm512_alignr_epi32 (x, zero, 14));
+        x = _mm512_add_epi32 (x, _mm512_alignr_epi32 (x, zero, 12));
+        x = _mm512_add_epi32 (x, _mm512_alignr_epi32 (x, zero, 8));
+        x = _mm512_add_epi32 (x, _mm512_set1_epi32 (*d));
+
+        m = lt ? _mm512_cmplt_epi32_mask (x, vk) : _mm512_cmpge_epi32_mask (x, vk);
+        _mm512_storeu_si512 ((void *) t, x);
+        if (m) {
+            *d = t[__builtin_ctz (m)];
+            return w + 1 + __builtin_ctz (m);
+        }
+        *d = t[15];
+        w += 16;
+    }
+
+    return sliding_find_tail (q, len, ws, w, d, k, lt);
+}
+
+__attribute__((target ("avx512f,avx512bw")))
+static int avx512_scan (const char *p, int n, int c, int lt) {
+    __m512i vc;
+    __mmask64 m;
+    int i;
+
+    if (c <= 0 || c > 127) return sliding_scan_clamp (n, c, lt);
+    vc = _mm512_set1_epi8 ((char) c);
+
+    for (i = 0; i + 64 <= n; i += 64) {
+        __m512i x = _mm512_loadu_si512 ((const void *) (p + i));
+        m = lt ? _mm512_cmplt_epi8_mask (x, vc) : _mm512_cmpge_epi8_mask (x, vc);
+        if (m) return i + __builtin_ctzll (m);
+    }
+    for (; i < n; i++) {
+        if (lt ? p[i] < c : p[i] >= c) return i;
+    }
+    return n;
+}
+
+SLIDING_KERNEL (avx512, "avx512f,avx512bw")
+
+#endif /* x86 */
+
+sliding_range sliding_select_range (void) {
+#ifdef SLIDING_SIMD
+    __builtin_cpu_init ();
+
+    if (__builtin_cpu_supports ("avx2")) return sliding_range_avx2;
+    if (__builtin_cpu_supports ("sse4.2")) return sliding_range_sse42;
+#endif
+    return NULL;
+}
+
+sliding_kernel sliding_get_kernel (const char *name) {
+#ifdef SLIDING_SIMD
+    __builtin_cpu_init ();
+
+    if (!strcmp (name, "avx512")) {
+        if (__builtin_cpu_supports ("avx512f") && __builtin_cpu_supports ("avx512bw")) return sliding_avx512;
+    } else if (!strcmp (name, "avx2")) {
+        if (__builtin_cpu_supports ("avx2")) return sliding_avx2;
+    } else if (!strcmp (name, "sse4.2")) {
+        if (__builtin_cpu_supports ("sse4.2")) return sliding_sse42;
+    }
+#endif
+    return NULL;
+}
+
+sliding_kernel sliding_select_kernel (void) {
+    static const char *names[] = {"avx512", "avx2", "sse4.2"};
+    sliding_kernel k;
+    int i;
+
+    for (i = 0; i < 3; i++) {
+        if ((k = sliding_get_kernel (names[i]))) return k;
+    }
+    return NULL;
+}
@@ -0,0 +1,39 @@
+#ifndef SLIDING_SIMD_H
+#define SLIDING_SIMD_H
+
+/* Vectorized versions of the window search in sliding_window().
+
+   A kernel gets the raw quality string of a read and finds the same
+   cut sites as the scalar loop in sliding.c: the 5' cut is the first
+   base >= qual_threshold in the first window whose average reaches the
+   threshold, and the 3' cut is the first base below the threshold in
+   the first later window whose average falls below it. Window totals
+   are compared as integers (total >= threshold * window size), and
+   they are built with prefix sums of the differences between the base
+   entering and the base leaving the window, so the quality offset only
+   matters for the first window.
+
+   Unless validate is 0 (trusted input), the whole quality string is
+   first checked against [qmin, qmax] in one vector pass. A kernel
+   returns whether a 5' cut was found (0 or 1), or -1 if a quality
+   character is out of range; sliding_window() then runs the scalar
+   code, which reports the bad record exactly as before. */
+
+typedef int (*sliding_kernel) (const char *qual, int len, int window_size, int offset, int qmin, int qmax, int validate, int qual_threshold, int no_fiveprime, int *five_prime_cut, int *three_prime_cut);
+
+/* the best kernel this CPU supports, or NULL for the scalar code */
+sliding_kernel sliding_select_kernel (void);
+
+/* Smallest and largest character of a quality string. If the smallest
+   is already at the threshold, no window can fall below it and the read
+   needs no trimming, so sliding_window() checks this before searching. */
+typedef void (*sliding_range) (const char *qual, int len, int *lo, int *hi);
+
+/* the best range function this CPU supports, or NULL */
+sliding_range sliding_select_range (void);
+
+/* a kernel by name ("sse4.2", "avx2" or "avx512"), or NULL if this CPU
+   (or compiler) does not support it */
+sliding_kernel sliding_get_kernel (const char *name);
+
+#endif /* SLIDING_SIMD_H */
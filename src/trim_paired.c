@@ -3,18 +3,80 @@
 #include <stdlib.h>
 #include <zlib.h>
 #include <stdio.h>
+#include <inttypes.h>
 #include <getopt.h>
 #include <unistd.h>
 #include "sickle.h"
 #include "kseq.h"
 #include "print_record.h"
-
-__KS_GETC(gzread, BUFFER_SIZE)
-__KS_GETUNTIL(gzread, BUFFER_SIZE)
+#include "gzwriter.h"
+#include "outsink.h"
+#include "fq_batch.h"
+#include "jobqueue.h"
+#include "profile.h"
+#include "qcstats.h"
+#include "outshard.h"
+#include "adapter.h"
+#include "lanes.h"
+#include "batch.h"
+
+__KS_GETC(infile_read, BUFFER_SIZE)
+__KS_GETUNTIL(infile_read, BUFFER_SIZE)
 __KSEQ_READ
 
-int paired_qual_threshold = 20;
-int paired_length_threshold = 20;
+/* records (two per pair) per batch handed to the trimming workers */
+#define PAIRED_BATCH_SIZE 4096
+
+typedef struct {
+    uint64_t kept_p;
+    uint64_t discard_p;
+    uint64_t kept_s1;
+    uint64_t kept_s2;
+    uint64_t discard_s1;
+    uint64_t discard_s2;
+} paired_counts;
+
+/* the names of the mates in the QC report */
+static const char *paired_qc_names[] = {"read1", "read2"};
+
+/* which of a batch's output buffers each kind of record goes to */
+enum {
+  PAIRED_OUT1,      /* forward reads, or both mates when interleaved */
+  PAIRED_OUT2,      /* reverse reads */
+  PAIRED_SINGLE     /* reads whose mate was discarded */
+};
+
+/* the outputs in the shard manifest, and records per pair in each */
+static const char *paired_shard_names[] = {"pe1", "pe2", "single"};
+static const int paired_shard_records[] = {1, 1, 1};
+static const char *paired_shard_names_combo[] = {"combo", NULL, "single"};
+static const int paired_shard_records_combo[] = {2, 0, 1};
+
+/* state shared by the reader, the trimming workers and the writer */
+typedef struct {
+    lanes *lanes;
+    kseq_t **fqrec1;            /* the parsers of each lane */
+    kseq_t **fqrec2;
+    uint64_t left;              /* pairs still to read (of a --region) */
+    int qualtype;
+    int no_fiveprime;
+    int trunc_n;
+    int trusted;                /* --trusted-input: no quality range check */
+    int debug;
+    int qual_threshold;
+    int length_threshold;
+    sliding_batch_fn trim;      /* the batch trimmer for these options */
+    volatile int failed;        /* a bad quality or a damaged input: drop the rest, the run fails */
+    int combo_all;
+    int interleaved;            /* both mates go to out[PAIRED_OUT1] */
+    outsink *out[FQ_BATCH_OUTPUTS];     /* indexed like the batch buffers, NULL if unused */
+    outshard *shards;           /* sharded output instead of out[], or NULL */
+    adapter_set *adapters;      /* adapter trimming, or NULL */
+    uint64_t total;
+    paired_counts *counts;      /* one entry per worker thread */
+    qcstats **qc;               /* QC statistics of each mate, two per thread, or NULL */
+    const int *qtab;
+} paired_pipeline;
 
 static struct option paired_long_options[] = {
     {"qual-type", required_argument, 0, 't'},
@@ -30,7 +92,24 @@ static struct option paired_long_options[] = {
     {"no-fiveprime", no_argument, 0, 'x'},
     {"truncate-n", no_argument, 0, 'n'},
     {"gzip-output", no_argument, 0, 'g'},
+    {"bgzf-output", no_argument, 0, 'b'},
+    {"bgzf-index", no_argument, 0, BGZF_INDEX_OPTION},
     {"output-combo-all", required_argument, 0, 'M'},
+    {"threads", required_argument, 0, 'T'},
+    {"read-buffer", required_argument, 0, READ_BUFFER_OPTION},
+    {"trusted-input", no_argument, 0, TRUSTED_INPUT_OPTION},
+    {"profile", optional_argument, 0, PROFILE_OPTION},
+    {"qc-report", required_argument, 0, QC_REPORT_OPTION},
+    {"shards", required_argument, 0, SHARDS_OPTION},
+    {"shard-by", required_argument, 0, SHARD_BY_OPTION},
+    {"adapter", required_argument, 0, ADAPTER_OPTION},
+    {"adapter-mismatches", required_argument, 0, ADAPTER_MISMATCHES_OPTION},
+    {"adapter-overlap", required_argument, 0, ADAPTER_OVERLAP_OPTION},
+    {"adapter-order", required_argument, 0, ADAPTER_ORDER_OPTION},
+    {"poly-tail", required_argument, 0, POLY_TAIL_OPTION},
+    {"poly-tail-length", required_argument, 0, POLY_TAIL_LENGTH_OPTION},
+    {"lane-order", required_argument, 0, LANE_ORDER_OPTION},
+    {"region", required_argument, 0, REGION_OPTION},
     {"quiet", no_argument, 0, 'z'},
     {GETOPT_HELP_OPTION_DECL},
     {GETOPT_VERSION_OPTION_DECL},
@@ -44,17 +123,18 @@ void paired_usage (int status, char *msg) {
     fprintf(stderr, "If you have one file with interleaved forward and reverse reads:\n");
     fprintf(stderr, "Usage: %s pe [options] -c <interleaved input file> -t <quality type> -m <interleaved trimmed paired-end output> -s <trimmed singles file>\n\n\
 If you have one file with interleaved reads as input and you want ONLY one interleaved file as output:\n\
-Usage: %s pe [options] -c <interleaved input file> -t <quality type> -M <interleaved trimmed output>\n\n", PROGRAM_NAME, PROGRAM_NAME);
+Usage: %s pe [options] -c <interleaved input file> -t <quality type> -M <interleaved trimmed output>\n\n\
+Any input or output file name can be - for standard input or standard output (at most one input and one output).\n\n", PROGRAM_NAME, PROGRAM_NAME);
     fprintf(stderr, "Options:\n\
 Paired-end separated reads\n\
 --------------------------\n\
--f, --pe-file1, Input paired-end forward fastq file (Input files must have same number of records)\n\
--r, --pe-file2, Input paired-end reverse fastq file\n\
+-f, --pe-file1, Input paired-end forward fastq file (Input files must have same number of records). Several files (lanes) can be given as a comma separated list, a glob pattern or more -f options.\n\
+-r, --pe-file2, Input paired-end reverse fastq file, or as many files as -f, in the same order.\n\
 -o, --output-pe1, Output trimmed forward fastq file\n\
 -p, --output-pe2, Output trimmed reverse fastq file. Must use -s option.\n\n\
 Paired-end interleaved reads\n\
 ----------------------------\n");
-    fprintf(stderr,"-c, --pe-combo, Combined (interleaved) input paired-end fastq\n\
+    fprintf(stderr,"-c, --pe-combo, Combined (interleaved) input paired-end fastq, or several files like -f.\n\
 -m, --output-combo, Output combined (interleaved) paired-end fastq file. Must use -s option.\n\
 -M, --output-combo-all, Output combined (interleaved) paired-end fastq file with any discarded read written to output file as a single N. Cannot be used with the -s option.\n\n\
 Global options\n\
@@ -67,7 +147,25 @@ Global options\n\
 -n, --truncate-n, Truncate sequences at position of first N.\n");
 
 
-    fprintf(stderr, "-g, --gzip-output, Output gzipped files.\n--quiet, do not output trimming info\n\
+    fprintf(stderr, "-g, --gzip-output, Output gzipped files.\n\
+-b, --bgzf-output, Output BGZF (block gzip) files, which are splittable and seekable.\n\
+--bgzf-index, Output BGZF files and write a .gzi block index next to each one.\n\
+-T, --threads, Number of trimming threads. Default 1.\n\
+--read-buffer, Size in MB of each input read-ahead buffer, or 0 to read without a read-ahead thread. Default 4.\n\
+--trusted-input, Skip the quality range check (only for input known to be valid).\n\
+--profile[=FILE], Report the time spent in each stage (reading, parsing, trimming, formatting, writing, compression) to stderr, or as JSON to FILE.\n\
+--qc-report FILE, Write read length, quality, N and cut position statistics of each mate from before and after trimming to FILE as JSON.\n\
+--shards N, Split every output into N files (out.0.fq ... out.<N-1>.fq), with both mates of a pair in the same shard, and list them in a .shards.tsv file next to the first output.\n\
+--shard-by, How pairs are spread over the shards: records (in turn) or bytes (to the smallest shard). Default records.\n\
+--adapter, 3' adapter sequence to trim from both mates; can be given several times. Mates that read through the insert are also clipped where they overlap.\n\
+--adapter-mismatches, Mismatches allowed over a whole adapter (proportionally fewer over a partial one). Default 2.\n\
+--adapter-overlap, Shortest start of an adapter at the 3' end of a read that is trimmed. Default 3.\n\
+--poly-tail, Trim 3' runs of these bases (e.g. G for two-colour chemistry, or AGT), allowing for some other bases in them.\n\
+--poly-tail-length, Shortest poly tail that is trimmed. Default 10.\n\
+--adapter-order, Trim adapters and poly tails before or after the quality trimming. Default before.\n\
+--lane-order, How pairs are taken from several input files: concat (one lane after the other) or interleave (a batch from each lane in turn, reading all of them at once). Default concat.\n\
+--region K/N, Trim only the K-th of N equal shares of the pairs, starting from the indexes written by sickle index. The outputs of regions 1 to N, in order, add up to the output of the whole input.\n\
+--quiet, do not output trimming info\n\
 --help, display this help and exit\n\
 --version, output version information and exit\n\n");
 
@@ -75,74 +173,321 @@ Global options\n\
     exit(status);
 }
 
+/* reader: fill a batch with pairs, returns 0 at end of input */
+static int paired_fill (void *arg, void *job) {
+    paired_pipeline *pp = (paired_pipeline *) arg;
+    fq_batch *b = (fq_batch *) job;
+    uint64_t t0 = PROFILE_START();
+    int l1, l2, k;
+
+    if (pp->failed) return 0;
+
+    fq_batch_clear(b);
+    while (b->n + 2 <= b->m && pp->left > 0 && (k = lanes_current(pp->lanes)) >= 0) {
+
+        if ((l1 = kseq_read(pp->fqrec1[k])) < 0) {
+            l2 = kseq_read(pp->fqrec2[k]);
+            if (l2 >= 0) {
+                fprintf(stderr, "Warning: PE file 1 is shorter than PE file 2. Disregarding rest of PE file 2.\n");
+            }
+            lanes_finish(pp->lanes);
+            continue;
+        }
+
+        l2 = kseq_read(pp->fqrec2[k]);
+        if (l2 < 0) {
+            fprintf(stderr, "Warning: PE file 2 is shorter than PE file 1. Disregarding rest of PE file 1.\n");
+            lanes_finish(pp->lanes);
+            continue;
+        }
+
+        /* a damaged input can end inside a record, which is not kept */
+        if (lanes_error(pp->lanes)) {
+            pp->failed = 1;
+            break;
+        }
+        fq_batch_push(b, pp->fqrec1[k]);
+        fq_batch_push(b, pp->fqrec2[k]);
+        pp->left--;
+    }
+    lanes_next(pp->lanes);
+    fq_batch_finish(b);
+    PROFILE_STOP(PROF_PARSE, t0, b->n, b->names.l + b->seqs.l + b->quals.l);
+
+    pp->total += b->n;
+    return b->n;
+}
+
+/* worker: find the cut sites of both mates of every pair in the batch and
+   format each record for the output it goes to */
+static void paired_trim (void *arg, void *job, int tid) {
+    paired_pipeline *pp = (paired_pipeline *) arg;
+    fq_batch *b = (fq_batch *) job;
+    paired_counts *c = &pp->counts[tid];
+    kstring_t *out1 = &b->out[PAIRED_OUT1];
+    kstring_t *out2 = pp->interleaved ? out1 : &b->out[PAIRED_OUT2];
+    kstring_t *single = &b->out[PAIRED_SINGLE];
+    kseq_t *fqrec1, *fqrec2;
+    cutsites *p1cut, *p2cut;
+    uint64_t t0;
+    size_t outlen;
+    int i, k;
+
+    /* batches still queued when the run failed are dropped */
+    if (pp->failed) return;
+
+    for (i = 0; i < FQ_BATCH_OUTPUTS; i++) b->out[i].l = 0;
+
+    t0 = PROFILE_START();
+
+    /* adapters, and read-through into them found from the overlap of the mates,
+       are clipped before the quality trimming or after it */
+    if (pp->adapters) {
+        adapter_locate(pp->adapters, b->rec, b->n, 1, b->clip);
+        if (!pp->adapters->after) adapter_hide(b->rec, b->n, b->clip);
+    }
+
+    /* both mates of every pair are trimmed in one go, except with debug output */
+    if (!pp->debug) {
+        if (pp->trim(b->rec, b->n, b->cut, pp->length_threshold, pp->qual_threshold) < 0) pp->failed = 1;
+    } else {
+        for (i = 0; i < b->n && !pp->failed; i += 2) {
+            b->cut[i] = sliding_window(&b->rec[i], pp->qualtype, pp->length_threshold, pp->qual_threshold, pp->no_fiveprime, pp->trunc_n, pp->trusted, pp->debug);
+            b->cut[i+1] = sliding_window(&b->rec[i+1], pp->qualtype, pp->length_threshold, pp->qual_threshold, pp->no_fiveprime, pp->trunc_n, pp->trusted, pp->debug);
+            if (b->cut[i].three_prime_cut == SLIDING_BAD_QUALITY || b->cut[i+1].three_prime_cut == SLIDING_BAD_QUALITY) pp->failed = 1;
+            else {
+                printf("p1cut: %d,%d\n", b->cut[i].five_prime_cut, b->cut[i].three_prime_cut);
+                printf("p2cut: %d,%d\n", b->cut[i+1].five_prime_cut, b->cut[i+1].three_prime_cut);
+            }
+        }
+    }
+    if (pp->failed) return;
+
+    if (pp->adapters) {
+        if (pp->adapters->after) adapter_apply(b->cut, b->n, b->clip, pp->length_threshold);
+        else adapter_restore(b->rec, b->n, b->clip);
+    }
+    PROFILE_STOP(PROF_TRIM, t0, b->n, b->seqs.l - b->n);
+
+    t0 = PROFILE_START();
+
+    for (i = 0; i < b->n; i += 2) {
+        fqrec1 = &b->rec[i];
+        fqrec2 = &b->rec[i+1];
+        p1cut = &b->cut[i];
+        p2cut = &b->cut[i+1];
+
+        /* The sequence and quality print statements below print out the sequence string starting from the 5' cut */
+        /* and then only print out to the 3' cut, however, we need to adjust the 3' cut */
+        /* by subtracting the 5' cut because the 3' cut was calculated on the original sequence */
+
+        /* if both sequences passed quality and length filters, then output both records */
+        if (p1cut->three_prime_cut >= 0 && p2cut->three_prime_cut >= 0) {
+            print_record (out1, fqrec1, p1cut);
+            print_record (out2, fqrec2, p2cut);
+            c->kept_p += 2;
+        }
+
+        /* if only one sequence passed filter, then put its record in singles and discard the other */
+        /* or put an "N" record in if that option was chosen. */
+        else if (p1cut->three_prime_cut >= 0 && p2cut->three_prime_cut < 0) {
+            if (pp->combo_all) {
+                print_record (out1, fqrec1, p1cut);
+                print_record_N (out1, fqrec2, pp->qualtype);
+            } else {
+                print_record (single, fqrec1, p1cut);
+            }
+            c->kept_s1++;
+            c->discard_s2++;
+        }
+
+        else if (p1cut->three_prime_cut < 0 && p2cut->three_prime_cut >= 0) {
+            if (pp->combo_all) {
+                print_record_N (out1, fqrec1, pp->qualtype);
+                print_record (out1, fqrec2, p2cut);
+            } else {
+                print_record (single, fqrec2, p2cut);
+            }
+            c->kept_s2++;
+            c->discard_s1++;
+
+        } else {
+
+            /* If both records are to be discarded, but the -M option */
+            /* is being used, then output two "N" records */
+            if (pp->combo_all) {
+                print_record_N (out1, fqrec1, pp->qualtype);
+                print_record_N (out1, fqrec2, pp->qualtype);
+            }
+            c->discard_p += 2;
+        }
+
+        if (pp->shards) {
+            for (k = 0; k < FQ_BATCH_OUTPUTS; k++) b->mark[FQ_BATCH_OUTPUTS * (i / 2) + k] = b->out[k].l;
+        }
+        if (pp->qc) {
+            qcstats_add(pp->qc[2*tid], fqrec1, p1cut, pp->qtab);
+            qcstats_add(pp->qc[2*tid+1], fqrec2, p2cut, pp->qtab);
+        }
+    }
+
+    if (profile_on) {
+        for (i = 0, outlen = 0; i < FQ_BATCH_OUTPUTS; i++) outlen += b->out[i].l;
+        profile_add(PROF_FORMAT, t0, b->n, outlen);
+    }
+}
+
+/* a forward input file is also a reverse one */
+static int paired_same_inputs (const lanes *l) {
+    int i, j;
+
+    for (i = 0; i < l->npath[0]; i++) {
+        for (j = 0; j < l->npath[1]; j++) {
+            if (!strcmp(l->path[0][i], l->path[1][j])) return 1;
+        }
+    }
+    return 0;
+}
+
+/* writer: copy the formatted records of a batch to the output files, in input order */
+static void paired_write (void *arg, void *job, int tid) {
+    paired_pipeline *pp = (paired_pipeline *) arg;
+    fq_batch *b = (fq_batch *) job;
+    uint64_t t0;
+    size_t outlen;
+    int i;
+
+    if (pp->failed) return;
+
+    if (pp->shards) {
+        t0 = PROFILE_START();
+        outshard_write(pp->shards, b->out, b->mark, b->n / 2);
+        if (profile_on) {
+            for (i = 0, outlen = 0; i < FQ_BATCH_OUTPUTS; i++) outlen += b->out[i].l;
+            profile_add(PROF_WRITE, t0, 0, outlen);
+        }
+        return;
+    }
+
+    for (i = 0; i < FQ_BATCH_OUTPUTS; i++) {
+        if (!pp->out[i]) continue;
+        t0 = PROFILE_START();
+        outsink_write(pp->out[i], b->out[i].s, b->out[i].l);
+        PROFILE_STOP(PROF_WRITE, t0, 0, b->out[i].l);
+    }
+}
+
+
+/* a usage error ends pe, but only fails the sample in sickle batch */
+static int paired_usage_error(batch_sample *job, char *msg) {
+    if (!job) paired_usage(EXIT_FAILURE, msg);
+    fprintf(stderr, "%s\n\n", msg);
+    return EXIT_FAILURE;
+}
 
 int paired_main(int argc, char *argv[]) {
+    return paired_run(argc, argv, NULL);
+}
 
-    gzFile pe1 = NULL;          /* forward input file handle */
-    gzFile pe2 = NULL;          /* reverse input file handle */
-    gzFile pec = NULL;          /* combined input file handle */
-    kseq_t *fqrec1 = NULL;
-    kseq_t *fqrec2 = NULL;
-    int l1, l2;
-    FILE *outfile1 = NULL;      /* forward output file handle */
-    FILE *outfile2 = NULL;      /* reverse output file handle */
-    FILE *combo = NULL;         /* combined output file handle */
-    FILE *single = NULL;        /* single output file handle */
-    gzFile outfile1_gzip = NULL;
-    gzFile outfile2_gzip = NULL;
-    gzFile combo_gzip = NULL;
-    gzFile single_gzip = NULL;
+/* pe itself; job is the sample when sickle batch runs it, or NULL */
+int paired_run(int argc, char *argv[], batch_sample *job) {
+
+    lanes *pairs = lanes_init(2);       /* forward and reverse input files */
+    lanes *combined = lanes_init(1);    /* combined input files */
+    lanes *inputs;                      /* whichever of the two is used */
+    int pec = 0;                        /* the input is combined */
+    kseq_t **fqrec1 = NULL;
+    kseq_t **fqrec2 = NULL;
+    outsink *outfile1 = NULL;   /* forward output file handle */
+    outsink *outfile2 = NULL;   /* reverse output file handle */
+    outsink *combo = NULL;      /* combined output file handle */
+    outsink *single = NULL;     /* single output file handle */
     int debug = 0;
     int optc;
     extern char *optarg;
     int qualtype = -1;
-    cutsites *p1cut;
-    cutsites *p2cut;
     char *outfn1 = NULL;        /* forward file out name */
     char *outfn2 = NULL;        /* reverse file out name */
     char *outfnc = NULL;        /* combined file out name */
     char *sfn = NULL;           /* single/combined file out name */
-    char *infn1 = NULL;         /* forward input filename */
-    char *infn2 = NULL;         /* reverse input filename */
-    char *infnc = NULL;         /* combined input filename */
-    int kept_p = 0;
-    int discard_p = 0;
-    int kept_s1 = 0;
-    int kept_s2 = 0;
-    int discard_s1 = 0;
-    int discard_s2 = 0;
+    uint64_t kept_p = 0;
+    uint64_t discard_p = 0;
+    uint64_t kept_s1 = 0;
+    uint64_t kept_s2 = 0;
+    uint64_t discard_s1 = 0;
+    uint64_t discard_s2 = 0;
     int quiet = 0;
     int no_fiveprime = 0;
     int trunc_n = 0;
+    int trusted = 0;
     int gzip_output = 0;
+    int gzip_format = GZW_GZIP;
+    int bgzf_index = 0;
     int combo_all=0;
     int combo_s=0;
-    int total=0;
+    uint64_t total=0;
+    int threads = 1;
+    int io_threads;
+    int qual_threshold = 20;
+    int length_threshold = 20;
+    int read_buffer = INFILE_BUFFER_MB;
+    char *profile_path = NULL;
+    char *qc_path = NULL;
+    FILE *summary = stdout;
+    int nshards = 0;
+    int shard_by = SHARD_RECORDS;
+    char **adapter_seqs = NULL;
+    int nadapters = 0;
+    int adapter_mismatches = 2;
+    int adapter_overlap = 3;
+    int adapter_after = 0;
+    char *poly_bases = NULL;
+    int poly_length = 10;
+    int lane_order = LANES_CONCAT;
+    int region_k = 0;
+    int region_n = 0;
+    uint64_t skip[2] = {0, 0};
+    uint64_t count = LANES_TO_END;
+    uint64_t j;
+    const char *bad;
+    const char *shard_paths[FQ_BATCH_OUTPUTS];
+    qcstats **qc = NULL;
+    int nslots;
+    int i;
+    paired_pipeline pp;
+    fq_batch **batches;
+    int ret = EXIT_FAILURE;
+
+    pp.shards = NULL;
+    pp.adapters = NULL;
 
     while (1) {
         int option_index = 0;
-        optc = getopt_long(argc, argv, "df:r:c:t:o:p:m:M:s:q:l:xng", paired_long_options, &option_index);
+        optc = getopt_long(argc, argv, "df:r:c:t:o:p:m:M:s:q:l:xngbT:", paired_long_options, &option_index);
 
         if (optc == -1)
             break;
 
+        /* in sickle batch a bad option fails this sample, not the whole batch */
+        if (job && (optc == '?' || optc == GETOPT_HELP_CHAR || optc == GETOPT_VERSION_CHAR)) {
+            if (optc != '?') fprintf(stderr, "****Error: --help and --version cannot be given to a sample.\n\n");
+            goto done;
+        }
+
         switch (optc) {
             if (paired_long_options[option_index].flag != 0)
                 break;
 
         case 'f':
-            infn1 = (char *) malloc(strlen(optarg) + 1);
-            strcpy(infn1, optarg);
+            lanes_add(pairs, 0, optarg);
             break;
 
         case 'r':
-            infn2 = (char *) malloc(strlen(optarg) + 1);
-            strcpy(infn2, optarg);
+            lanes_add(pairs, 1, optarg);
             break;
 
         case 'c':
-            infnc = (char *) malloc(strlen(optarg) + 1);
-            strcpy(infnc, optarg);
+            lanes_add(combined, 0, optarg);
             break;
 
         case 't':
@@ -151,7 +496,7 @@ int paired_main(int argc, char *argv[]) {
             else if (!strcmp(optarg, "sanger")) qualtype = SANGER;
             else {
                 fprintf(stderr, "Error: Quality type '%s' is not a valid type.\n", optarg);
-                return EXIT_FAILURE;
+                goto done;
             }
             break;
 
@@ -183,18 +528,18 @@ int paired_main(int argc, char *argv[]) {
             break;
 
         case 'q':
-            paired_qual_threshold = atoi(optarg);
-            if (paired_qual_threshold < 0) {
+            qual_threshold = atoi(optarg);
+            if (qual_threshold < 0) {
                 fprintf(stderr, "Quality threshold must be >= 0\n");
-                return EXIT_FAILURE;
+                goto done;
             }
             break;
 
         case 'l':
-            paired_length_threshold = atoi(optarg);
-            if (paired_length_threshold < 0) {
+            length_threshold = atoi(optarg);
+            if (length_threshold < 0) {
                 fprintf(stderr, "Length threshold must be >= 0\n");
-                return EXIT_FAILURE;
+                goto done;
             }
             break;
 
@@ -210,6 +555,130 @@ int paired_main(int argc, char *argv[]) {
             gzip_output = 1;
             break;
 
+        case 'b':
+            gzip_output = 1;
+            gzip_format = GZW_BGZF;
+            break;
+
+        case BGZF_INDEX_OPTION:
+            gzip_output = 1;
+            gzip_format = GZW_BGZF;
+            bgzf_index = 1;
+            break;
+
+        case 'T':
+            threads = atoi(optarg);
+            if (threads < 1) {
+                fprintf(stderr, "Number of threads must be >= 1\n");
+                goto done;
+            }
+            break;
+
+        case READ_BUFFER_OPTION:
+            read_buffer = atoi(optarg);
+            if (read_buffer < 0) {
+                fprintf(stderr, "Read buffer size must be >= 0\n");
+                goto done;
+            }
+            break;
+
+        case TRUSTED_INPUT_OPTION:
+            trusted = 1;
+            break;
+
+        case PROFILE_OPTION:
+            /* the profile of a batch covers all of its samples */
+            if (job) {
+                fprintf(stderr, "****Error: --profile cannot be given to a sample (use sickle batch --profile).\n\n");
+                goto done;
+            }
+            profile_begin();
+            profile_path = optarg;
+            break;
+
+        case QC_REPORT_OPTION:
+            qc_path = optarg;
+            break;
+
+        case SHARDS_OPTION:
+            nshards = atoi(optarg);
+            if (nshards < 1) {
+                fprintf(stderr, "Number of shards must be >= 1\n");
+                goto done;
+            }
+            break;
+
+        case ADAPTER_OPTION:
+            adapter_seqs = (char **) realloc(adapter_seqs, (nadapters + 1) * sizeof(char *));
+            adapter_seqs[nadapters++] = optarg;
+            break;
+
+        case ADAPTER_MISMATCHES_OPTION:
+            adapter_mismatches = atoi(optarg);
+            if (adapter_mismatches < 0) {
+                fprintf(stderr, "Adapter mismatches must be >= 0\n");
+                goto done;
+            }
+            break;
+
+        case ADAPTER_OVERLAP_OPTION:
+            adapter_overlap = atoi(optarg);
+            if (adapter_overlap < 1) {
+                fprintf(stderr, "Adapter overlap must be >= 1\n");
+                goto done;
+            }
+            break;
+
+        case POLY_TAIL_OPTION:
+            poly_bases = optarg;
+            break;
+
+        case POLY_TAIL_LENGTH_OPTION:
+            poly_length = atoi(optarg);
+            if (poly_length < 1) {
+                fprintf(stderr, "Poly tail length must be >= 1\n");
+                goto done;
+            }
+            break;
+
+        case ADAPTER_ORDER_OPTION:
+            if (!strcmp(optarg, "before"))
+                adapter_after = 0;
+            else if (!strcmp(optarg, "after"))
+                adapter_after = 1;
+            else {
+                fprintf(stderr, "Error: Adapter order '%s' is not valid (before or after).\n", optarg);
+                goto done;
+            }
+            break;
+
+        case LANE_ORDER_OPTION:
+            if (!strcmp(optarg, "concat")) lane_order = LANES_CONCAT;
+            else if (!strcmp(optarg, "interleave")) lane_order = LANES_INTERLEAVE;
+            else {
+                fprintf(stderr, "Error: Lane order '%s' is not valid (concat or interleave).\n", optarg);
+                goto done;
+            }
+            break;
+
+        case REGION_OPTION:
+            if (!lanes_parse_region(optarg, &region_k, &region_n)) {
+                fprintf(stderr, "Error: Region '%s' is not valid (K/N, with 1 <= K <= N).\n", optarg);
+                goto done;
+            }
+            break;
+
+        case SHARD_BY_OPTION:
+            if (!strcmp(optarg, "records"))
+                shard_by = SHARD_RECORDS;
+            else if (!strcmp(optarg, "bytes"))
+                shard_by = SHARD_BYTES;
+            else {
+                fprintf(stderr, "Error: Shard mode '%s' is not valid (records or bytes).\n", optarg);
+                goto done;
+            }
+            break;
+
         case 'z':
             quiet = 1;
             break;
@@ -231,292 +700,290 @@ int paired_main(int argc, char *argv[]) {
         }
     }
 
+    /* in sickle batch the next sample can read its options now, and the trimming threads are the batch's */
+    if (job) {
+        batch_started(job);
+        threads = job->pool->nworkers;
+        quiet = 1;
+    }
+    /* the inputs of a batch sample are inflated on one thread, as every sample would
+       start threads of its own; its gzip outputs share the batch's compression pool */
+    io_threads = job ? 1 : threads;
+
     /* required: qualtype */
     if (qualtype == -1) {
-        paired_usage(EXIT_FAILURE, "****Error: Quality type is required.");
+        paired_usage_error(job, "****Error: Quality type is required.");
+        goto done;
     }
 
     /* make sure minimum input filenames are specified */
-    if (!infn1 && !infnc) {
-        paired_usage(EXIT_FAILURE, "****Error: Must have either -f OR -c argument.");
+    if (!pairs->npath[0] && !combined->npath[0]) {
+        paired_usage_error(job, "****Error: Must have either -f OR -c argument.");
+        goto done;
     }
 
-    if (infnc) {      /* using combined input file */
+    /* with trimmed records on standard output, the summary goes to standard error */
+    if ((outfnc && IS_STDIO(outfnc)) || (outfn1 && IS_STDIO(outfn1)) || (outfn2 && IS_STDIO(outfn2)) || (sfn && !combo_all && IS_STDIO(sfn))) {
+        if (bgzf_index) {
+            fprintf(stderr, "****Error: Cannot write a BGZF index for standard output.\n\n");
+            goto done;
+        }
+        if (nshards) {
+            fprintf(stderr, "****Error: Cannot split standard output into shards.\n\n");
+            goto done;
+        }
+        summary = stderr;
+    }
 
-        if (infn1 || infn2 || outfn1 || outfn2) {
-            paired_usage(EXIT_FAILURE, "****Error: Cannot have -f, -r, -o, or -p options with -c.");
+    if (nadapters || poly_bases) {
+        pp.adapters = adapter_init(adapter_mismatches, adapter_overlap, adapter_after);
+        for (i = 0; i < nadapters; i++) {
+            if (adapter_add(pp.adapters, adapter_seqs[i]) != 0) goto done;
+        }
+        if (poly_bases && !(pp.adapters->poly = polytail_init(poly_bases, poly_length))) goto done;
+    }
+
+    if (combined->npath[0]) {      /* using combined input file */
+
+        if (pairs->npath[0] || pairs->npath[1] || outfn1 || outfn2) {
+            paired_usage_error(job, "****Error: Cannot have -f, -r, -o, or -p options with -c.");
+            goto done;
         }
 
         if ((combo_all && combo_s) || (!combo_all && !combo_s)) {
-            paired_usage(EXIT_FAILURE, "****Error: Must have only one of either -m or -M options with -c.");
+            paired_usage_error(job, "****Error: Must have only one of either -m or -M options with -c.");
+            goto done;
         }
 
         if ((combo_s && !sfn) || (combo_all && sfn)) {
-            paired_usage(EXIT_FAILURE, "****Error: -m option must have -s option, and -M option cannot have -s option.");
+            paired_usage_error(job, "****Error: -m option must have -s option, and -M option cannot have -s option.");
+            goto done;
         }
 
         /* check for duplicate file names */
-        if (!strcmp(infnc, outfnc) || (combo_s && (!strcmp(infnc, sfn) || !strcmp(outfnc, sfn)))) {
+        if (lanes_has(combined, outfnc) || (combo_s && (lanes_has(combined, sfn) || !strcmp(outfnc, sfn)))) {
             fprintf(stderr, "****Error: Duplicate filename between combo input, combo output, and/or single output file names.\n\n");
-            return EXIT_FAILURE;
+            goto done;
         }
 
         /* get combined output file */
-        if (!gzip_output) {
-            combo = fopen(outfnc, "w");
+        if (!nshards) {
+            combo = outsink_open(outfnc, gzip_output, threads, gzip_format, bgzf_index);
             if (!combo) {
                 fprintf(stderr, "****Error: Could not open combo output file '%s'.\n\n", outfnc);
-                return EXIT_FAILURE;
-            }
-        } else {
-            combo_gzip = gzopen(outfnc, "w");
-            if (!combo_gzip) {
-                fprintf(stderr, "****Error: Could not open combo output file '%s'.\n\n", outfnc);
-                return EXIT_FAILURE;
+                goto done;
             }
         }
 
-        pec = gzopen(infnc, "r");
-        if (!pec) {
-            fprintf(stderr, "****Error: Could not open combined input file '%s'.\n\n", infnc);
-            return EXIT_FAILURE;
+        if (region_n) {
+            if (lanes_open_region(combined, region_k, region_n, 1, (size_t) read_buffer * 1024 * 1024, skip, &count) != 0) goto done;
+        } else if ((bad = lanes_open(combined, lane_order, io_threads, (size_t) read_buffer * 1024 * 1024))) {
+            fprintf(stderr, "****Error: Could not open combined input file '%s'.\n\n", bad);
+            goto done;
         }
+        pec = 1;
 
     } else {     /* using forward and reverse input files */
 
-        if (infn1 && (!infn2 || !outfn1 || !outfn2 || !sfn)) {
-            paired_usage(EXIT_FAILURE, "****Error: Using the -f option means you must have the -r, -o, -p, and -s options.");
+        if (pairs->npath[0] && (!pairs->npath[1] || !outfn1 || !outfn2 || !sfn)) {
+            paired_usage_error(job, "****Error: Using the -f option means you must have the -r, -o, -p, and -s options.");
+            goto done;
         }
 
-        if (infn1 && (infnc || combo_all || combo_s)) {
-            paired_usage(EXIT_FAILURE, "****Error: The -f option cannot be used in combination with -c, -m, or -M.");
+        if (pairs->npath[0] && (combo_all || combo_s)) {
+            paired_usage_error(job, "****Error: The -f option cannot be used in combination with -c, -m, or -M.");
+            goto done;
         }
 
-        if (!strcmp(infn1, infn2) || !strcmp(infn1, outfn1) || !strcmp(infn1, outfn2) ||
-            !strcmp(infn1, sfn) || !strcmp(infn2, outfn1) || !strcmp(infn2, outfn2) || 
-            !strcmp(infn2, sfn) || !strcmp(outfn1, outfn2) || !strcmp(outfn1, sfn) || !strcmp(outfn2, sfn)) {
-
-            fprintf(stderr, "****Error: Duplicate input and/or output file names.\n\n");
-            return EXIT_FAILURE;
+        if (pairs->npath[0] != pairs->npath[1]) {
+            fprintf(stderr, "****Error: -f has %d input files and -r has %d; every lane needs both.\n\n", pairs->npath[0], pairs->npath[1]);
+            goto done;
         }
 
-        pe1 = gzopen(infn1, "r");
-        if (!pe1) {
-            fprintf(stderr, "****Error: Could not open input file '%s'.\n\n", infn1);
-            return EXIT_FAILURE;
+        if (paired_same_inputs(pairs) || lanes_has(pairs, outfn1) || lanes_has(pairs, outfn2) || lanes_has(pairs, sfn) ||
+            !strcmp(outfn1, outfn2) || !strcmp(outfn1, sfn) || !strcmp(outfn2, sfn)) {
+
+            fprintf(stderr, "****Error: Duplicate input and/or output file names.\n\n");
+            goto done;
         }
 
-        pe2 = gzopen(infn2, "r");
-        if (!pe2) {
-            fprintf(stderr, "****Error: Could not open input file '%s'.\n\n", infn2);
-            return EXIT_FAILURE;
+        /* both mates start at the same pair, each from the access point of its own index */
+        if (region_n) {
+            if (lanes_open_region(pairs, region_k, region_n, 0, (size_t) read_buffer * 1024 * 1024, skip, &count) != 0) goto done;
+        } else if ((bad = lanes_open(pairs, lane_order, io_threads, (size_t) read_buffer * 1024 * 1024))) {
+            fprintf(stderr, "****Error: Could not open input file '%s'.\n\n", bad);
+            goto done;
         }
 
-        if (!gzip_output) {
-            outfile1 = fopen(outfn1, "w");
+        if (!nshards) {
+            outfile1 = outsink_open(outfn1, gzip_output, threads, gzip_format, bgzf_index);
             if (!outfile1) {
                 fprintf(stderr, "****Error: Could not open output file '%s'.\n\n", outfn1);
-                return EXIT_FAILURE;
+                goto done;
             }
 
-            outfile2 = fopen(outfn2, "w");
+            outfile2 = outsink_open(outfn2, gzip_output, threads, gzip_format, bgzf_index);
             if (!outfile2) {
                 fprintf(stderr, "****Error: Could not open output file '%s'.\n\n", outfn2);
-                return EXIT_FAILURE;
-            }
-        } else {
-            outfile1_gzip = gzopen(outfn1, "w");
-            if (!outfile1_gzip) {
-                fprintf(stderr, "****Error: Could not open output file '%s'.\n\n", outfn1);
-                return EXIT_FAILURE;
-            }
-
-            outfile2_gzip = gzopen(outfn2, "w");
-            if (!outfile2_gzip) {
-                fprintf(stderr, "****Error: Could not open output file '%s'.\n\n", outfn2);
-                return EXIT_FAILURE;
-            }
-
-        }
-    }
-
-    /* get singles output file handle */
-    if (sfn && !combo_all) {
-        if (!gzip_output) {
-            single = fopen(sfn, "w");
-            if (!single) {
-                fprintf(stderr, "****Error: Could not open single output file '%s'.\n\n", sfn);
-                return EXIT_FAILURE;
-            }
-        } else {
-            single_gzip = gzopen(sfn, "w");
-            if (!single_gzip) {
-                fprintf(stderr, "****Error: Could not open single output file '%s'.\n\n", sfn);
-                return EXIT_FAILURE;
+                goto done;
             }
         }
     }
 
-    if (pec) {
-        fqrec1 = kseq_init(pec);
-        fqrec2 = (kseq_t *) malloc(sizeof(kseq_t));
-        fqrec2->f = fqrec1->f;
-    } else {
-        fqrec1 = kseq_init(pe1);
-        fqrec2 = kseq_init(pe2);
+    /* with --shards, every output is split into shards that take a pair at a time */
+    if (nshards) {
+        shard_paths[PAIRED_OUT1] = pec ? outfnc : outfn1;
+        shard_paths[PAIRED_OUT2] = pec ? NULL : outfn2;
+        shard_paths[PAIRED_SINGLE] = (sfn && !combo_all) ? sfn : NULL;
+        pp.shards = outshard_open(shard_paths, pec ? paired_shard_names_combo : paired_shard_names,
+            pec ? paired_shard_records_combo : paired_shard_records, FQ_BATCH_OUTPUTS, nshards, shard_by,
+            gzip_output, threads, gzip_format, bgzf_index);
+        if (!pp.shards) goto done;
     }
 
-    while ((l1 = kseq_read(fqrec1)) >= 0) {
-
-        l2 = kseq_read(fqrec2);
-        if (l2 < 0) {
-            fprintf(stderr, "Warning: PE file 2 is shorter than PE file 1. Disregarding rest of PE file 1.\n");
-            break;
-        }
-
-        p1cut = sliding_window(fqrec1, qualtype, paired_length_threshold, paired_qual_threshold, no_fiveprime, trunc_n, debug);
-        p2cut = sliding_window(fqrec2, qualtype, paired_length_threshold, paired_qual_threshold, no_fiveprime, trunc_n, debug);
-        total += 2;
-
-        if (debug) printf("p1cut: %d,%d\n", p1cut->five_prime_cut, p1cut->three_prime_cut);
-        if (debug) printf("p2cut: %d,%d\n", p2cut->five_prime_cut, p2cut->three_prime_cut);
-
-        /* The sequence and quality print statements below print out the sequence string starting from the 5' cut */
-        /* and then only print out to the 3' cut, however, we need to adjust the 3' cut */
-        /* by subtracting the 5' cut because the 3' cut was calculated on the original sequence */
-
-        /* if both sequences passed quality and length filters, then output both records */
-        if (p1cut->three_prime_cut >= 0 && p2cut->three_prime_cut >= 0) {
-            if (!gzip_output) {
-                if (pec) {
-                    print_record (combo, fqrec1, p1cut);
-                    print_record (combo, fqrec2, p2cut);
-                } else {
-                    print_record (outfile1, fqrec1, p1cut);
-                    print_record (outfile2, fqrec2, p2cut);
-                }
-            } else {
-                if (pec) {
-                    print_record_gzip (combo_gzip, fqrec1, p1cut);
-                    print_record_gzip (combo_gzip, fqrec2, p2cut);
-                } else {
-                    print_record_gzip (outfile1_gzip, fqrec1, p1cut);
-                    print_record_gzip (outfile2_gzip, fqrec2, p2cut);
-                }
-            }
-
-            kept_p += 2;
+    /* get singles output file handle */
+    if (sfn && !combo_all && !nshards) {
+        single = outsink_open(sfn, gzip_output, threads, gzip_format, bgzf_index);
+        if (!single) {
+            fprintf(stderr, "****Error: Could not open single output file '%s'.\n\n", sfn);
+            goto done;
         }
+    }
 
-        /* if only one sequence passed filter, then put its record in singles and discard the other */
-        /* or put an "N" record in if that option was chosen. */
-        else if (p1cut->three_prime_cut >= 0 && p2cut->three_prime_cut < 0) {
-            if (!gzip_output) {
-                if (combo_all) {
-                    print_record (combo, fqrec1, p1cut);
-                    print_record_N (combo, fqrec2, qualtype);
-                } else {
-                    print_record (single, fqrec1, p1cut);
-                }
-            } else {
-                if (combo_all) {
-                    print_record_gzip (combo_gzip, fqrec1, p1cut);
-                    print_record_N_gzip (combo_gzip, fqrec2, qualtype);
-                } else {
-                    print_record_gzip (single_gzip, fqrec1, p1cut);
-                }
-            }
-
-            kept_s1++;
-            discard_s2++;
+    /* both mates of a combined lane are read from its one stream */
+    inputs = pec ? combined : pairs;
+    fqrec1 = (kseq_t **) malloc(inputs->n * sizeof(kseq_t *));
+    fqrec2 = (kseq_t **) malloc(inputs->n * sizeof(kseq_t *));
+    for (i = 0; i < inputs->n; i++) {
+        fqrec1[i] = kseq_init(inputs->in[0][i]);
+        if (pec) {
+            fqrec2[i] = (kseq_t *) calloc(1, sizeof(kseq_t));
+            fqrec2[i]->f = fqrec1[i]->f;
         }
+        else fqrec2[i] = kseq_init(inputs->in[1][i]);
+    }
+    for (j = 0; j < skip[0] && kseq_read(fqrec1[0]) >= 0; j++);
+    for (j = 0; j < skip[1] && kseq_read(fqrec2[0]) >= 0; j++);
+
+    pp.lanes = inputs;
+    pp.fqrec1 = fqrec1;
+    pp.fqrec2 = fqrec2;
+    pp.left = count;
+    pp.qualtype = qualtype;
+    pp.no_fiveprime = no_fiveprime;
+    pp.trunc_n = trunc_n;
+    pp.trusted = trusted;
+    pp.trim = sliding_select_batch(qualtype, no_fiveprime, trunc_n, trusted);
+    pp.failed = 0;
+    pp.debug = debug;
+    pp.qual_threshold = qual_threshold;
+    pp.length_threshold = length_threshold;
+    pp.combo_all = combo_all;
+    pp.interleaved = pec;
+    pp.out[PAIRED_OUT1] = pec ? combo : outfile1;
+    pp.out[PAIRED_OUT2] = outfile2;
+    pp.out[PAIRED_SINGLE] = single;
+    pp.total = 0;
+    pp.counts = (paired_counts *) calloc(threads + 1, sizeof(paired_counts));
+    if (qc_path) {
+        qc = (qcstats **) malloc(2 * (threads + 1) * sizeof(qcstats *));
+        for (i = 0; i < 2 * (threads + 1); i++) qc[i] = qcstats_init();
+    }
+    pp.qc = qc;
+    pp.qtab = sliding_quality_table(qualtype);
+
+    /* a single thread runs the reader, trimming and writer in turn on one batch; */
+    /* otherwise keep enough batches in flight for every worker plus the reader and writer */
+    nslots = (threads > 1 || job) ? 2 * threads + 2 : 1;
+    batches = (fq_batch **) malloc(nslots * sizeof(fq_batch *));
+    for (i = 0; i < nslots; i++) batches[i] = fq_batch_init(PAIRED_BATCH_SIZE);
+
+    if (job) jobqueue_run_pool(job->pool, (void **) batches, nslots, paired_fill, paired_trim, paired_write, &pp);
+    else jobqueue_run((void **) batches, nslots, (threads > 1) ? threads : 0, paired_fill, paired_trim, paired_write, &pp);
+
+    total = pp.total;
+    for (i = 0; i <= threads; i++) {
+        kept_p += pp.counts[i].kept_p;
+        discard_p += pp.counts[i].discard_p;
+        kept_s1 += pp.counts[i].kept_s1;
+        kept_s2 += pp.counts[i].kept_s2;
+        discard_s1 += pp.counts[i].discard_s1;
+        discard_s2 += pp.counts[i].discard_s2;
+    }
 
-        else if (p1cut->three_prime_cut < 0 && p2cut->three_prime_cut >= 0) {
-            if (!gzip_output) {
-                if (combo_all) {
-                    print_record_N (combo, fqrec1, qualtype);
-                    print_record (combo, fqrec2, p2cut);
-                } else {
-                    print_record (single, fqrec2, p2cut);
-                }
-            } else {
-                if (combo_all) {
-                    print_record_N_gzip (combo_gzip, fqrec1, qualtype);
-                    print_record_gzip (combo_gzip, fqrec2, p2cut);
-                } else {
-                    print_record_gzip (single_gzip, fqrec2, p2cut);
-                }
-            }
+    for (i = 0; i < nslots; i++) fq_batch_destroy(batches[i]);
+    free(batches);
+    free(pp.counts);
 
-            kept_s2++;
-            discard_s1++;
+    /* a bad quality or a read error has been reported, and fails the run */
+    ret = (pp.failed || lanes_error(inputs)) ? EXIT_FAILURE : EXIT_SUCCESS;
 
+    if (!quiet && ret == EXIT_SUCCESS) {
+        if (pec) {
+            fprintf(summary, "\nPE interleaved file%s: ", (inputs->n > 1) ? "s" : "");
+            lanes_print(summary, inputs, 0);
+            fprintf(summary, "\n");
         } else {
-
-            /* If both records are to be discarded, but the -M option */
-            /* is being used, then output two "N" records */
-            if (combo_all) {
-                if (!gzip_output) {
-                    print_record_N (combo, fqrec1, qualtype);
-                    print_record_N (combo, fqrec2, qualtype);
-                } else {
-                    print_record_N_gzip (combo_gzip, fqrec1, qualtype);
-                    print_record_N_gzip (combo_gzip, fqrec2, qualtype);
-                }
-            }
-
-            discard_p += 2;
+            fprintf(summary, "\nPE forward file%s: ", (inputs->n > 1) ? "s" : "");
+            lanes_print(summary, inputs, 0);
+            fprintf(summary, "\nPE reverse file%s: ", (inputs->n > 1) ? "s" : "");
+            lanes_print(summary, inputs, 1);
+            fprintf(summary, "\n");
         }
+        fprintf(summary, "\nTotal input FastQ records: %" PRIu64 " (%" PRIu64 " pairs)\n", total, (total / 2));
+        fprintf(summary, "\nFastQ paired records kept: %" PRIu64 " (%" PRIu64 " pairs)\n", kept_p, (kept_p / 2));
+        if (pec) fprintf(summary, "FastQ single records kept: %" PRIu64 "\n", (kept_s1 + kept_s2));
+        else fprintf(summary, "FastQ single records kept: %" PRIu64 " (from PE1: %" PRIu64 ", from PE2: %" PRIu64 ")\n", (kept_s1 + kept_s2), kept_s1, kept_s2);
 
-        free(p1cut);
-        free(p2cut);
-    }             /* end of while ((l1 = kseq_read (fqrec1)) >= 0) */
-
-    if (l1 < 0) {
-        l2 = kseq_read(fqrec2);
-        if (l2 >= 0) {
-            fprintf(stderr, "Warning: PE file 1 is shorter than PE file 2. Disregarding rest of PE file 2.\n");
-        }
-    }
-
-    if (!quiet) {
-        if (infn1 && infn2) fprintf(stdout, "\nPE forward file: %s\nPE reverse file: %s\n", infn1, infn2);
-        if (infnc) fprintf(stdout, "\nPE interleaved file: %s\n", infnc);
-        fprintf(stdout, "\nTotal input FastQ records: %d (%d pairs)\n", total, (total / 2));
-        fprintf(stdout, "\nFastQ paired records kept: %d (%d pairs)\n", kept_p, (kept_p / 2));
-        if (pec) fprintf(stdout, "FastQ single records kept: %d\n", (kept_s1 + kept_s2));
-        else fprintf(stdout, "FastQ single records kept: %d (from PE1: %d, from PE2: %d)\n", (kept_s1 + kept_s2), kept_s1, kept_s2);
-
-        fprintf(stdout, "FastQ paired records discarded: %d (%d pairs)\n", discard_p, (discard_p / 2));
+        fprintf(summary, "FastQ paired records discarded: %" PRIu64 " (%" PRIu64 " pairs)\n", discard_p, (discard_p / 2));
 
-        if (pec) fprintf(stdout, "FastQ single records discarded: %d\n\n", (discard_s1 + discard_s2));
-        else fprintf(stdout, "FastQ single records discarded: %d (from PE1: %d, from PE2: %d)\n\n", (discard_s1 + discard_s2), discard_s1, discard_s2);
+        if (pec) fprintf(summary, "FastQ single records discarded: %" PRIu64 "\n\n", (discard_s1 + discard_s2));
+        else fprintf(summary, "FastQ single records discarded: %" PRIu64 " (from PE1: %" PRIu64 ", from PE2: %" PRIu64 ")\n\n", (discard_s1 + discard_s2), discard_s1, discard_s2);
     }
 
-    kseq_destroy(fqrec1);
-    if (pec) free(fqrec2);
-    else kseq_destroy(fqrec2);
-
-    if (sfn && !combo_all) {
-        if (!gzip_output) fclose(single);
-        else gzclose(single_gzip);
+    /* every return, failed or not, comes through here */
+done:
+    if (fqrec1) {
+        for (i = 0; i < inputs->n; i++) {
+            kseq_destroy(fqrec1[i]);
+            if (pec) free(fqrec2[i]);
+            else kseq_destroy(fqrec2[i]);
+        }
+        free(fqrec1);
+        free(fqrec2);
     }
-
-    if (pec) {
-        gzclose(pec);
-        if (!gzip_output) fclose(combo);
-        else gzclose(combo_gzip);
-    } else {
-        gzclose(pe1);
-        gzclose(pe2);
-        if (!gzip_output) {
-            fclose(outfile1);
-            fclose(outfile2);
-        } else {
-            gzclose(outfile1_gzip);
-            gzclose(outfile2_gzip);
+    lanes_close(pairs);
+    lanes_close(combined);
+
+    if (outsink_close(single) != 0) ret = EXIT_FAILURE;
+    if (outshard_close(pp.shards) != 0) ret = EXIT_FAILURE;
+    adapter_destroy(pp.adapters);
+    free(adapter_seqs);
+
+    if (outsink_close(combo) != 0) ret = EXIT_FAILURE;
+    if (outsink_close(outfile1) != 0) ret = EXIT_FAILURE;
+    if (outsink_close(outfile2) != 0) ret = EXIT_FAILURE;
+
+    if (qc) {
+        if (ret == EXIT_SUCCESS) {
+            for (i = 2; i < 2 * (threads + 1); i++) qcstats_merge(qc[i % 2], qc[i]);
+            if (qcstats_report(qc_path, "pe", total, kept_p + kept_s1 + kept_s2, discard_p + discard_s1 + discard_s2, qc, paired_qc_names, 2) != 0) ret = EXIT_FAILURE;
         }
+        for (i = 0; i < 2 * (threads + 1); i++) qcstats_destroy(qc[i]);
+        free(qc);
     }
 
-    return EXIT_SUCCESS;
-}                               /* end of paired_main() */
+    if (job) {
+        job->total = total;
+        job->kept = kept_p + kept_s1 + kept_s2;
+        job->discard = discard_p + discard_s1 + discard_s2;
+        job->singles = kept_s1 + kept_s2;
+    }
+    else if (ret == EXIT_SUCCESS) profile_report(profile_path);
+
+    free(outfn1);
+    free(outfn2);
+    free(outfnc);
+    free(sfn);
+    return ret;
+}                               /* end of paired_run() */
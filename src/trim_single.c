@@ -3,17 +3,67 @@
 #include <stdlib.h>
 #include <zlib.h>
 #include <stdio.h>
+#include <inttypes.h>
 #include <getopt.h>
 #include "sickle.h"
 #include "kseq.h"
 #include "print_record.h"
-
-__KS_GETC(gzread, BUFFER_SIZE)
-__KS_GETUNTIL(gzread, BUFFER_SIZE)
+#include "gzwriter.h"
+#include "outsink.h"
+#include "fq_batch.h"
+#include "jobqueue.h"
+#include "profile.h"
+#include "qcstats.h"
+#include "outshard.h"
+#include "adapter.h"
+#include "lanes.h"
+#include "batch.h"
+
+__KS_GETC(infile_read, BUFFER_SIZE)
+__KS_GETUNTIL(infile_read, BUFFER_SIZE)
 __KSEQ_READ
 
-int single_qual_threshold = 20;
-int single_length_threshold = 20;
+/* records per batch handed to the trimming workers */
+#define SINGLE_BATCH_SIZE 4096
+
+/* bytes of a memory-mapped input file handed to a worker at a time */
+#define SINGLE_RANGE_SIZE (4 * 1024 * 1024)
+
+/* the name of the read in the QC report */
+static const char *single_qc_names[] = {"read"};
+
+/* the output in the shard manifest, and records per unit */
+static const char *single_shard_names[] = {"trimmed"};
+static const int single_shard_records[] = {1};
+
+/* state shared by the reader, the trimming workers and the writer */
+typedef struct {
+    lanes *lanes;
+    kseq_t **fqrec;             /* the parser of each lane */
+    uint64_t left;              /* records still to read (of a --region) */
+    const char *map;            /* mapped input file, or NULL to read through fqrec */
+    size_t maplen;
+    size_t mappos;
+    size_t next;                /* where the record after the last one written starts */
+    volatile int stop;          /* a truncated record was met, drop the rest */
+    volatile int failed;        /* a bad quality or a damaged input: drop the rest, the run fails */
+    int qualtype;
+    int no_fiveprime;
+    int trunc_n;
+    int trusted;                /* --trusted-input: no quality range check */
+    int debug;
+    int qual_threshold;
+    int length_threshold;
+    sliding_batch_fn trim;      /* the batch trimmer for these options */
+    outsink *outfile;
+    outshard *shards;           /* sharded output instead of outfile, or NULL */
+    adapter_set *adapters;      /* adapter trimming, or NULL */
+    qcstats **qc;               /* QC statistics of each thread, or NULL */
+    const int *qtab;
+    uint64_t total;
+    uint64_t kept;
+    uint64_t discard;
+} single_pipeline;
 
 static struct option single_long_options[] = {
     {"fastq-file", required_argument, 0, 'f'},
@@ -24,6 +74,24 @@ static struct option single_long_options[] = {
     {"no-fiveprime", no_argument, 0, 'x'},
     {"discard-n", no_argument, 0, 'n'},
     {"gzip-output", no_argument, 0, 'g'},
+    {"bgzf-output", no_argument, 0, 'b'},
+    {"bgzf-index", no_argument, 0, BGZF_INDEX_OPTION},
+    {"threads", required_argument, 0, 'T'},
+    {"read-buffer", required_argument, 0, READ_BUFFER_OPTION},
+    {"no-mmap", no_argument, 0, NO_MMAP_OPTION},
+    {"trusted-input", no_argument, 0, TRUSTED_INPUT_OPTION},
+    {"profile", optional_argument, 0, PROFILE_OPTION},
+    {"qc-report", required_argument, 0, QC_REPORT_OPTION},
+    {"shards", required_argument, 0, SHARDS_OPTION},
+    {"shard-by", required_argument, 0, SHARD_BY_OPTION},
+    {"adapter", required_argument, 0, ADAPTER_OPTION},
+    {"adapter-mismatches", required_argument, 0, ADAPTER_MISMATCHES_OPTION},
+    {"adapter-overlap", required_argument, 0, ADAPTER_OVERLAP_OPTION},
+    {"adapter-order", required_argument, 0, ADAPTER_ORDER_OPTION},
+    {"poly-tail", required_argument, 0, POLY_TAIL_OPTION},
+    {"poly-tail-length", required_argument, 0, POLY_TAIL_LENGTH_OPTION},
+    {"lane-order", required_argument, 0, LANE_ORDER_OPTION},
+    {"region", required_argument, 0, REGION_OPTION},
     {"quiet", no_argument, 0, 'z'},
     {GETOPT_HELP_OPTION_DECL},
     {GETOPT_VERSION_OPTION_DECL},
@@ -35,15 +103,33 @@ void single_usage(int status, char *msg) {
     fprintf(stderr, "\nUsage: %s se [options] -f <fastq sequence file> -t <quality type> -o <trimmed fastq file>\n\
 \n\
 Options:\n\
--f, --fastq-file, Input fastq file (required)\n\
+-f, --fastq-file, Input fastq file, or - for standard input (required). Several files (lanes) can be given as a comma separated list, a glob pattern or more -f options.\n\
 -t, --qual-type, Type of quality values (solexa (CASAVA < 1.3), illumina (CASAVA 1.3 to 1.7), sanger (which is CASAVA >= 1.8)) (required)\n\
--o, --output-file, Output trimmed fastq file (required)\n", PROGRAM_NAME);
+-o, --output-file, Output trimmed fastq file, or - for standard output (required)\n", PROGRAM_NAME);
 
     fprintf(stderr, "-q, --qual-threshold, Threshold for trimming based on average quality in a window. Default 20.\n\
 -l, --length-threshold, Threshold to keep a read based on length after trimming. Default 20.\n\
 -x, --no-fiveprime, Don't do five prime trimming.\n\
 -n, --trunc-n, Truncate sequences at position of first N.\n\
 -g, --gzip-output, Output gzipped files.\n\
+-b, --bgzf-output, Output BGZF (block gzip) files, which are splittable and seekable.\n\
+--bgzf-index, Output BGZF files and write a .gzi block index next to each one.\n\
+-T, --threads, Number of trimming threads. Default 1.\n\
+--read-buffer, Size in MB of each input read-ahead buffer, or 0 to read without a read-ahead thread. Default 4.\n\
+--no-mmap, Read uncompressed input through the read-ahead buffers instead of mapping it into memory.\n\
+--trusted-input, Skip the quality range check (only for input known to be valid).\n\
+--profile[=FILE], Report the time spent in each stage (reading, parsing, trimming, formatting, writing, compression) to stderr, or as JSON to FILE.\n\
+--qc-report FILE, Write read length, quality, N and cut position statistics from before and after trimming to FILE as JSON.\n\
+--shards N, Split the output into N files (out.0.fq ... out.<N-1>.fq) and list them in out.fq.shards.tsv.\n\
+--shard-by, How reads are spread over the shards: records (in turn) or bytes (to the smallest shard). Default records.\n\
+--adapter, 3' adapter sequence to trim; can be given several times.\n\
+--adapter-mismatches, Mismatches allowed over a whole adapter (proportionally fewer over a partial one). Default 2.\n\
+--adapter-overlap, Shortest start of an adapter at the 3' end of a read that is trimmed. Default 3.\n\
+--poly-tail, Trim 3' runs of these bases (e.g. G for two-colour chemistry, or AGT), allowing for some other bases in them.\n\
+--poly-tail-length, Shortest poly tail that is trimmed. Default 10.\n\
+--adapter-order, Trim adapters and poly tails before or after the quality trimming. Default before.\n\
+--lane-order, How records are taken from several input files: concat (one file after the other) or interleave (a batch from each in turn, reading all of them at once). Default concat.\n\
+--region K/N, Trim only the K-th of N equal shares of the records, starting from the index written by sickle index. The outputs of regions 1 to N, in order, add up to the output of the whole file.\n\
 --quiet, Don't print out any trimming information\n\
 --help, display this help and exit\n\
 --version, output version information and exit\n\n");
@@ -52,42 +138,247 @@ Options:\n\
     exit(status);
 }
 
+/* reader: fill a batch from the input file, returns 0 at end of file */
+static int single_fill(void *arg, void *job) {
+    single_pipeline *sp = (single_pipeline *) arg;
+    fq_batch *b = (fq_batch *) job;
+    size_t end;
+    uint64_t t0;
+    int k;
+
+    if (sp->failed) return 0;
+
+    /* a mapped file is handed out as ranges that start on a record */
+    if (sp->map) {
+        if (sp->stop || sp->mappos >= sp->maplen) return 0;
+
+        end = sp->mappos + SINGLE_RANGE_SIZE;
+        if (end >= sp->maplen) end = sp->maplen;
+        else end = fq_record_start(sp->map, sp->maplen, end);
+
+        b->text = sp->map;
+        b->textlen = sp->maplen;
+        b->beg = sp->mappos;
+        b->end = end;
+        sp->mappos = end;
+        return 1;
+    }
+
+    t0 = PROFILE_START();
+    fq_batch_clear(b);
+    while (b->n < b->m && sp->left > 0 && (k = lanes_current(sp->lanes)) >= 0) {
+        /* a lane ends at its end of file or at a truncated record */
+        if (kseq_read(sp->fqrec[k]) < 0) {
+            lanes_finish(sp->lanes);
+            continue;
+        }
+        /* a damaged input can end inside a record, which is not kept */
+        if (lanes_error(sp->lanes)) {
+            sp->failed = 1;
+            break;
+        }
+        fq_batch_push(b, sp->fqrec[k]);
+        sp->left--;
+    }
+    lanes_next(sp->lanes);
+    fq_batch_finish(b);
+    PROFILE_STOP(PROF_PARSE, t0, b->n, b->names.l + b->seqs.l + b->quals.l);
+
+    return b->n;
+}
+
+/* worker: find the cut sites of every record in the batch and format the kept ones */
+static void single_trim(void *arg, void *job, int tid) {
+    single_pipeline *sp = (single_pipeline *) arg;
+    fq_batch *b = (fq_batch *) job;
+    uint64_t t0;
+    int i;
+
+    /* batches still queued when the run failed are dropped */
+    if (sp->failed) return;
+
+    if (b->text) {
+        t0 = PROFILE_START();
+        fq_batch_parse(b);
+        PROFILE_STOP(PROF_PARSE, t0, b->n, b->names.l + b->seqs.l + b->quals.l);
+    }
+
+    b->kept = b->discard = 0;
+    b->out[0].l = 0;
+
+    t0 = PROFILE_START();
+
+    /* adapters are clipped before the quality trimming (which then only sees the rest) or after it */
+    if (sp->adapters) {
+        adapter_locate(sp->adapters, b->rec, b->n, 0, b->clip);
+        if (!sp->adapters->after) adapter_hide(b->rec, b->n, b->clip);
+    }
+
+    /* the whole batch is trimmed in one go, except with debug output, which goes record by record */
+    if (!sp->debug) {
+        if (sp->trim(b->rec, b->n, b->cut, sp->length_threshold, sp->qual_threshold) < 0) sp->failed = 1;
+    } else {
+        for (i = 0; i < b->n && !sp->failed; i++) {
+            b->cut[i] = sliding_window(&b->rec[i], sp->qualtype, sp->length_threshold, sp->qual_threshold, sp->no_fiveprime, sp->trunc_n, sp->trusted, sp->debug);
+            if (b->cut[i].three_prime_cut == SLIDING_BAD_QUALITY) sp->failed = 1;
+            else printf("P1cut: %d,%d\n", b->cut[i].five_prime_cut, b->cut[i].three_prime_cut);
+        }
+    }
+    if (sp->failed) return;
+
+    if (sp->adapters) {
+        if (sp->adapters->after) adapter_apply(b->cut, b->n, b->clip, sp->length_threshold);
+        else adapter_restore(b->rec, b->n, b->clip);
+    }
+    PROFILE_STOP(PROF_TRIM, t0, b->n, b->seqs.l - b->n);
+
+    t0 = PROFILE_START();
+
+    for (i = 0; i < b->n; i++) {
+        /* if sequence quality and length pass filter then output record, else discard */
+        if (b->cut[i].three_prime_cut >= 0) {
+            /* This print statement prints out the sequence string starting from the 5' cut */
+            /* and then only prints out to the 3' cut, however, we need to adjust the 3' cut */
+            /* by subtracting the 5' cut because the 3' cut was calculated on the original sequence */
+            /* A read that is kept whole is copied straight from a mapped input when its bytes allow. */
+            if (!b->text || b->cut[i].five_prime_cut != 0 || b->cut[i].three_prime_cut != b->rec[i].seq.l
+                || !print_record_raw (&b->out[0], &b->rec[i], b->text + b->raw[2*i], b->raw[2*i+1] - b->raw[2*i]))
+                print_record (&b->out[0], &b->rec[i], &b->cut[i]);
+            b->kept++;
+        } else {
+            b->discard++;
+        }
+
+        if (sp->shards) b->mark[i] = b->out[0].l;
+        if (sp->qc) qcstats_add(sp->qc[tid], &b->rec[i], &b->cut[i], sp->qtab);
+    }
+    PROFILE_STOP(PROF_FORMAT, t0, b->kept, b->out[0].l);
+}
+
+/* writer: output the kept records of a batch, in input order */
+static void single_write(void *arg, void *job, int tid) {
+    single_pipeline *sp = (single_pipeline *) arg;
+    fq_batch *b = (fq_batch *) job;
+    uint64_t t0;
+    int i;
+
+    /* like kseq_read(), give up on the whole input after a truncated record */
+    if (sp->stop || sp->failed) return;
+
+    /* The last record of the previous range may have run on into this one
+       (only in malformed files); parse this range again from where it
+       actually ended. */
+    if (b->text) {
+        if (b->beg > 0 && b->first != sp->next) {
+            if (sp->qc) {
+                for (i = 0; i < b->n; i++) qcstats_remove(sp->qc[tid], &b->rec[i], &b->cut[i], sp->qtab);
+            }
+            b->beg = sp->next;
+            single_trim(arg, job, tid);
+        }
+        sp->next = b->next;
+    }
+
+    if (b->truncated) sp->stop = 1;
+
+    sp->total += b->n;
+    sp->kept += b->kept;
+    sp->discard += b->discard;
+
+    t0 = PROFILE_START();
+    if (sp->shards) outshard_write(sp->shards, b->out, b->mark, b->n);
+    else outsink_write(sp->outfile, b->out[0].s, b->out[0].l);
+    PROFILE_STOP(PROF_WRITE, t0, b->kept, b->out[0].l);
+}
+
+/* a usage error ends se, but only fails the sample in sickle batch */
+static int single_usage_error(batch_sample *job, char *msg) {
+    if (!job) single_usage(EXIT_FAILURE, msg);
+    fprintf(stderr, "%s\n\n", msg);
+    return EXIT_FAILURE;
+}
+
 int single_main(int argc, char *argv[]) {
+    return single_run(argc, argv, NULL);
+}
+
+/* se itself; job is the sample when sickle batch runs it, or NULL */
+int single_run(int argc, char *argv[], batch_sample *job) {
 
-    gzFile se = NULL;
-    kseq_t *fqrec;
-    int l;
-    FILE *outfile = NULL;
-    gzFile outfile_gzip = NULL;
+    lanes *inputs = lanes_init(1);
+    kseq_t **fqrec = NULL;
+    outsink *outfile = NULL;
     int debug = 0;
     int optc;
     extern char *optarg;
     int qualtype = -1;
-    cutsites *p1cut;
     char *outfn = NULL;
-    char *infn = NULL;
-    int kept = 0;
-    int discard = 0;
+    uint64_t kept = 0;
+    uint64_t discard = 0;
     int quiet = 0;
     int no_fiveprime = 0;
     int trunc_n = 0;
+    int trusted = 0;
     int gzip_output = 0;
-    int total=0;
+    int gzip_format = GZW_GZIP;
+    int bgzf_index = 0;
+    uint64_t total=0;
+    int threads = 1;
+    int io_threads;
+    int qual_threshold = 20;
+    int length_threshold = 20;
+    int read_buffer = INFILE_BUFFER_MB;
+    int use_mmap = 1;
+    char *profile_path = NULL;
+    char *qc_path = NULL;
+    FILE *summary = stdout;
+    int nshards = 0;
+    int shard_by = SHARD_RECORDS;
+    char **adapter_seqs = NULL;
+    int nadapters = 0;
+    int adapter_mismatches = 2;
+    int adapter_overlap = 3;
+    int adapter_after = 0;
+    char *poly_bases = NULL;
+    int poly_length = 10;
+    int lane_order = LANES_CONCAT;
+    int region_k = 0;
+    int region_n = 0;
+    uint64_t skip[2] = {0, 0};
+    uint64_t count = LANES_TO_END;
+    uint64_t j;
+    const char *bad;
+    qcstats **qc = NULL;
+    const char *map = NULL;
+    size_t maplen = 0;
+    int nslots;
+    int i;
+    single_pipeline sp;
+    fq_batch **batches;
+    int ret = EXIT_FAILURE;
+
+    sp.shards = NULL;
+    sp.adapters = NULL;
 
     while (1) {
         int option_index = 0;
-        optc = getopt_long(argc, argv, "df:t:o:q:l:zxng", single_long_options, &option_index);
+        optc = getopt_long(argc, argv, "df:t:o:q:l:zxngbT:", single_long_options, &option_index);
 
         if (optc == -1)
             break;
 
+        /* in sickle batch a bad option fails this sample, not the whole batch */
+        if (job && (optc == '?' || optc == GETOPT_HELP_CHAR || optc == GETOPT_VERSION_CHAR)) {
+            if (optc != '?') fprintf(stderr, "****Error: --help and --version cannot be given to a sample.\n\n");
+            goto done;
+        }
+
         switch (optc) {
             if (single_long_options[option_index].flag != 0)
                 break;
 
         case 'f':
-            infn = (char *) malloc(strlen(optarg) + 1);
-            strcpy(infn, optarg);
+            lanes_add(inputs, 0, optarg);
             break;
 
         case 't':
@@ -99,7 +390,7 @@ int single_main(int argc, char *argv[]) {
                 qualtype = SANGER;
             else {
                 fprintf(stderr, "Error: Quality type '%s' is not a valid type.\n", optarg);
-                return EXIT_FAILURE;
+                goto done;
             }
             break;
 
@@ -109,18 +400,18 @@ int single_main(int argc, char *argv[]) {
             break;
 
         case 'q':
-            single_qual_threshold = atoi(optarg);
-            if (single_qual_threshold < 0) {
+            qual_threshold = atoi(optarg);
+            if (qual_threshold < 0) {
                 fprintf(stderr, "Quality threshold must be >= 0\n");
-                return EXIT_FAILURE;
+                goto done;
             }
             break;
 
         case 'l':
-            single_length_threshold = atoi(optarg);
-            if (single_length_threshold < 0) {
+            length_threshold = atoi(optarg);
+            if (length_threshold < 0) {
                 fprintf(stderr, "Length threshold must be >= 0\n");
-                return EXIT_FAILURE;
+                goto done;
             }
             break;
 
@@ -136,6 +427,136 @@ int single_main(int argc, char *argv[]) {
             gzip_output = 1;
             break;
 
+        case 'b':
+            gzip_output = 1;
+            gzip_format = GZW_BGZF;
+            break;
+
+        case BGZF_INDEX_OPTION:
+            gzip_output = 1;
+            gzip_format = GZW_BGZF;
+            bgzf_index = 1;
+            break;
+
+        case 'T':
+            threads = atoi(optarg);
+            if (threads < 1) {
+                fprintf(stderr, "Number of threads must be >= 1\n");
+                goto done;
+            }
+            break;
+
+        case READ_BUFFER_OPTION:
+            read_buffer = atoi(optarg);
+            if (read_buffer < 0) {
+                fprintf(stderr, "Read buffer size must be >= 0\n");
+                goto done;
+            }
+            break;
+
+        case NO_MMAP_OPTION:
+            use_mmap = 0;
+            break;
+
+        case TRUSTED_INPUT_OPTION:
+            trusted = 1;
+            break;
+
+        case PROFILE_OPTION:
+            /* the profile of a batch covers all of its samples */
+            if (job) {
+                fprintf(stderr, "****Error: --profile cannot be given to a sample (use sickle batch --profile).\n\n");
+                goto done;
+            }
+            profile_begin();
+            profile_path = optarg;
+            break;
+
+        case QC_REPORT_OPTION:
+            qc_path = optarg;
+            break;
+
+        case SHARDS_OPTION:
+            nshards = atoi(optarg);
+            if (nshards < 1) {
+                fprintf(stderr, "Number of shards must be >= 1\n");
+                goto done;
+            }
+            break;
+
+        case ADAPTER_OPTION:
+            adapter_seqs = (char **) realloc(adapter_seqs, (nadapters + 1) * sizeof(char *));
+            adapter_seqs[nadapters++] = optarg;
+            break;
+
+        case ADAPTER_MISMATCHES_OPTION:
+            adapter_mismatches = atoi(optarg);
+            if (adapter_mismatches < 0) {
+                fprintf(stderr, "Adapter mismatches must be >= 0\n");
+                goto done;
+            }
+            break;
+
+        case ADAPTER_OVERLAP_OPTION:
+            adapter_overlap = atoi(optarg);
+            if (adapter_overlap < 1) {
+                fprintf(stderr, "Adapter overlap must be >= 1\n");
+                goto done;
+            }
+            break;
+
+        case POLY_TAIL_OPTION:
+            poly_bases = optarg;
+            break;
+
+        case POLY_TAIL_LENGTH_OPTION:
+            poly_length = atoi(optarg);
+            if (poly_length < 1) {
+                fprintf(stderr, "Poly tail length must be >= 1\n");
+                goto done;
+            }
+            break;
+
+        case ADAPTER_ORDER_OPTION:
+            if (!strcmp(optarg, "before"))
+                adapter_after = 0;
+            else if (!strcmp(optarg, "after"))
+                adapter_after = 1;
+            else {
+                fprintf(stderr, "Error: Adapter order '%s' is not valid (before or after).\n", optarg);
+                goto done;
+            }
+            break;
+
+        case LANE_ORDER_OPTION:
+            if (!strcmp(optarg, "concat"))
+                lane_order = LANES_CONCAT;
+            else if (!strcmp(optarg, "interleave"))
+                lane_order = LANES_INTERLEAVE;
+            else {
+                fprintf(stderr, "Error: Lane order '%s' is not valid (concat or interleave).\n", optarg);
+                goto done;
+            }
+            break;
+
+        case REGION_OPTION:
+            if (!lanes_parse_region(optarg, &region_k, &region_n)) {
+                fprintf(stderr, "Error: Region '%s' is not valid (K/N, with 1 <= K <= N).\n", optarg);
+                goto done;
+            }
+            break;
+
+        case SHARD_BY_OPTION:
+            if (!strcmp(optarg, "records"))
+                shard_by = SHARD_RECORDS;
+            else if (!strcmp(optarg, "bytes"))
+                shard_by = SHARD_BYTES;
+            else {
+                fprintf(stderr, "Error: Shard mode '%s' is not valid (records or bytes).\n", optarg);
+                goto done;
+            }
+            break;
+
         case 'z':
             quiet = 1;
             break;
@@ -158,71 +579,161 @@ int single_main(int argc, char *argv[]) {
     }
 
 
-    if (qualtype == -1 || !infn || !outfn) {
-        single_usage(EXIT_FAILURE, "****Error: Must have quality type, input file, and output file.");
+    /* in sickle batch the next sample can read its options now, and the trimming threads are the batch's */
+    if (job) {
+        batch_started(job);
+        threads = job->pool->nworkers;
+        quiet = 1;
     }
+    /* the inputs of a batch sample are inflated on one thread, as every sample would
+       start threads of its own; its gzip outputs share the batch's compression pool */
+    io_threads = job ? 1 : threads;
 
-    if (!strcmp(infn, outfn)) {
-        fprintf(stderr, "****Error: Input file is same as output file.\n\n");
-        return EXIT_FAILURE;
+    if (qualtype == -1 || !inputs->npath[0] || !outfn) {
+        single_usage_error(job, "****Error: Must have quality type, input file, and output file.");
+        goto done;
     }
 
-    se = gzopen(infn, "r");
-    if (!se) {
-        fprintf(stderr, "****Error: Could not open input file '%s'.\n\n", infn);
-        return EXIT_FAILURE;
+    /* standard input and standard output are not the same file */
+    if (lanes_has(inputs, outfn)) {
+        fprintf(stderr, "****Error: Input file is same as output file.\n\n");
+        goto done;
     }
 
-    if (!gzip_output) {
-        outfile = fopen(outfn, "w");
-        if (!outfile) {
-            fprintf(stderr, "****Error: Could not open output file '%s'.\n\n", outfn);
-            return EXIT_FAILURE;
-        }
-    } else {
-        outfile_gzip = gzopen(outfn, "w");
-        if (!outfile_gzip) {
-            fprintf(stderr, "****Error: Could not open output file '%s'.\n\n", outfn);
-            return EXIT_FAILURE;
-        }
+    if (bgzf_index && IS_STDIO(outfn)) {
+        fprintf(stderr, "****Error: Cannot write a BGZF index for standard output.\n\n");
+        goto done;
     }
 
+    if (nshards && IS_STDIO(outfn)) {
+        fprintf(stderr, "****Error: Cannot split standard output into shards.\n\n");
+        goto done;
+    }
 
-    fqrec = kseq_init(se);
-
-    while ((l = kseq_read(fqrec)) >= 0) {
+    if (nadapters || poly_bases) {
+        sp.adapters = adapter_init(adapter_mismatches, adapter_overlap, adapter_after);
+        for (i = 0; i < nadapters; i++) {
+            if (adapter_add(sp.adapters, adapter_seqs[i]) != 0) goto done;
+        }
+        if (poly_bases && !(sp.adapters->poly = polytail_init(poly_bases, poly_length))) goto done;
+    }
 
-        p1cut = sliding_window(fqrec, qualtype, single_length_threshold, single_qual_threshold, no_fiveprime, trunc_n, debug);
-        total++;
+    /* with the trimmed records on standard output, the summary goes to standard error */
+    if (IS_STDIO(outfn)) summary = stderr;
 
-        if (debug) printf("P1cut: %d,%d\n", p1cut->five_prime_cut, p1cut->three_prime_cut);
+    /* a plain file is parsed in place from memory, in ranges split across the workers */
+    if (use_mmap && inputs->npath[0] == 1 && !region_n) map = infile_map(inputs->path[0][0], &maplen);
 
-        /* if sequence quality and length pass filter then output record, else discard */
-        if (p1cut->three_prime_cut >= 0) {
-            if (!gzip_output) {
-                /* This print statement prints out the sequence string starting from the 5' cut */
-                /* and then only prints out to the 3' cut, however, we need to adjust the 3' cut */
-                /* by subtracting the 5' cut because the 3' cut was calculated on the original sequence */
-
-                print_record (outfile, fqrec, p1cut);
-            } else {
-                print_record_gzip (outfile_gzip, fqrec, p1cut);
-            }
+    /* a region starts from the index of the input, at the access point before its first record */
+    if (region_n) {
+        if (lanes_open_region(inputs, region_k, region_n, 0, (size_t) read_buffer * 1024 * 1024, skip, &count) != 0) goto done;
+    } else if (!map && (bad = lanes_open(inputs, lane_order, io_threads, (size_t) read_buffer * 1024 * 1024))) {
+        fprintf(stderr, "****Error: Could not open input file '%s'.\n\n", bad);
+        goto done;
+    }
 
-            kept++;
+    if (nshards) {
+        sp.shards = outshard_open((const char **) &outfn, single_shard_names, single_shard_records, 1, nshards, shard_by,
+            gzip_output, threads, gzip_format, bgzf_index);
+        if (!sp.shards) goto done;
+    } else {
+        outfile = outsink_open(outfn, gzip_output, threads, gzip_format, bgzf_index);
+        if (!outfile) {
+            fprintf(stderr, "****Error: Could not open output file '%s'.\n\n", outfn);
+            goto done;
         }
+    }
 
-        else discard++;
 
-        free(p1cut);
+    if (!map) {
+        fqrec = (kseq_t **) malloc(inputs->n * sizeof(kseq_t *));
+        for (i = 0; i < inputs->n; i++) fqrec[i] = kseq_init(inputs->in[0][i]);
+        for (j = 0; j < skip[0] && kseq_read(fqrec[0]) >= 0; j++);
     }
 
-    if (!quiet) fprintf(stdout, "\nSE input file: %s\n\nTotal FastQ records: %d\nFastQ records kept: %d\nFastQ records discarded: %d\n\n", infn, total, kept, discard);
+    sp.lanes = inputs;
+    sp.fqrec = fqrec;
+    sp.left = count;
+    sp.map = map;
+    sp.maplen = maplen;
+    sp.mappos = 0;
+    sp.next = 0;
+    sp.stop = 0;
+    sp.failed = 0;
+    sp.qualtype = qualtype;
+    sp.no_fiveprime = no_fiveprime;
+    sp.trunc_n = trunc_n;
+    sp.trusted = trusted;
+    sp.trim = sliding_select_batch(qualtype, no_fiveprime, trunc_n, trusted);
+    sp.debug = debug;
+    sp.qual_threshold = qual_threshold;
+    sp.length_threshold = length_threshold;
+    sp.outfile = outfile;
+    /* one set of statistics per thread: the workers are 1 .. threads, the writer 0 */
+    if (qc_path) {
+        qc = (qcstats **) malloc((threads + 1) * sizeof(qcstats *));
+        for (i = 0; i <= threads; i++) qc[i] = qcstats_init();
+    }
+    sp.qc = qc;
+    sp.qtab = sliding_quality_table(qualtype);
+    sp.total = 0;
+    sp.kept = 0;
+    sp.discard = 0;
+
+    /* a single thread runs the reader, trimming and writer in turn on one batch; */
+    /* otherwise keep enough batches in flight for every worker plus the reader and writer */
+    nslots = (threads > 1 || job) ? 2 * threads + 2 : 1;
+    batches = (fq_batch **) malloc(nslots * sizeof(fq_batch *));
+    for (i = 0; i < nslots; i++) batches[i] = fq_batch_init(SINGLE_BATCH_SIZE);
+
+    if (job) jobqueue_run_pool(job->pool, (void **) batches, nslots, single_fill, single_trim, single_write, &sp);
+    else jobqueue_run((void **) batches, nslots, (threads > 1) ? threads : 0, single_fill, single_trim, single_write, &sp);
+
+    total = sp.total;
+    kept = sp.kept;
+    discard = sp.discard;
+
+    for (i = 0; i < nslots; i++) fq_batch_destroy(batches[i]);
+    free(batches);
+
+    /* a bad quality or a read error has been reported, and fails the run */
+    ret = (sp.failed || lanes_error(inputs)) ? EXIT_FAILURE : EXIT_SUCCESS;
+
+    if (!quiet && ret == EXIT_SUCCESS) {
+        fprintf(summary, "\nSE input file%s: ", (inputs->npath[0] > 1) ? "s" : "");
+        lanes_print(summary, inputs, 0);
+        fprintf(summary, "\n\nTotal FastQ records: %" PRIu64 "\nFastQ records kept: %" PRIu64 "\nFastQ records discarded: %" PRIu64 "\n\n", total, kept, discard);
+    }
 
-    kseq_destroy(fqrec);
-    gzclose(se);
-    if (!gzip_output) fclose(outfile);
-    else gzclose(outfile_gzip);
+    /* every return, failed or not, comes through here */
+done:
+    if (map) infile_unmap(map, maplen);
+    if (fqrec) {
+        for (i = 0; i < inputs->n; i++) kseq_destroy(fqrec[i]);
+        free(fqrec);
+    }
+    lanes_close(inputs);
+    if (outsink_close(outfile) != 0) ret = EXIT_FAILURE;
+    if (outshard_close(sp.shards) != 0) ret = EXIT_FAILURE;
+    adapter_destroy(sp.adapters);
+    free(adapter_seqs);
+
+    if (qc) {
+        if (ret == EXIT_SUCCESS) {
+            for (i = 1; i <= threads; i++) qcstats_merge(qc[0], qc[i]);
+            if (qcstats_report(qc_path, "se", total, kept, discard, qc, single_qc_names, 1) != 0) ret = EXIT_FAILURE;
+        }
+        for (i = 0; i <= threads; i++) qcstats_destroy(qc[i]);
+        free(qc);
+    }
+
+    if (job) {
+        job->total = total;
+        job->kept = kept;
+        job->discard = discard;
+    }
+    else if (ret == EXIT_SUCCESS) profile_report(profile_path);
 
-    return EXIT_SUCCESS;
+    free(outfn);
+    return ret;
 }